@@ -53,6 +53,13 @@ public:
      */
     A(const Record &record) : Extractor(record, TYPE_A, 4), _ip((struct in_addr *)_record.data()) {}
     
+    /**
+     *  Check if the constructor can be called without an exception
+     *  @param  record
+     *  @return bool
+     */
+    static bool valid(const Record &record) { return Extractor::valid(record, TYPE_A, 4); }
+
     /**
      *  Destructor
      */
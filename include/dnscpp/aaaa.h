@@ -52,6 +52,13 @@ public:
      */
     AAAA(const Record &record) : Extractor(record, TYPE_AAAA, 16), _ip((struct in6_addr *)_record.data()) {}
     
+    /**
+     *  Check if the constructor can be called without an exception
+     *  @param  record
+     *  @return bool
+     */
+    static bool valid(const Record &record) { return Extractor::valid(record, TYPE_AAAA, 16); }
+
     /**
      *  Destructor
      */
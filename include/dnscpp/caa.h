@@ -95,6 +95,17 @@ public:
         _size = propsize;
     }
     
+    /**
+     *  Check if the constructor can be called without an exception
+     *  @param  response
+     *  @param  record
+     *  @return bool
+     */
+    static bool valid(const Response &response, const Record &record)
+    {
+        return Extractor::valid(record, TYPE_CAA, 3) && record.data()[1] >= 1 && record.data()[1] <= 15;
+    }
+
     /**
      *  Destructor
      */
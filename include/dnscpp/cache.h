@@ -0,0 +1,218 @@
+/**
+ *  Cache.h
+ *
+ *  In-process cache with responses that were received from the nameservers.
+ *  When the cache is enabled (via Context::cache()), responses are stored in
+ *  their raw form, and future queries for the same name, type, class and bits
+ *  are answered from the cache until the TTL of the response expires. When
+ *  the response is taken from the cache, the ID and all TTLs are rewritten.
+ *
+ *  Negative responses (NXDOMAIN, and NOERROR without answers) are cached too,
+ *  as described in RFC 2308. For these responses only the question and the SOA
+ *  record from the authority section are stored, and the TTL is taken from
+ *  that SOA record. Responses without a SOA record are not cached.
+ *
+ *  The cache has a memory budget. When the budget is exceeded, the least
+ *  recently used responses are evicted.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Query;
+class Response;
+
+/**
+ *  Class definition
+ */
+class Cache
+{
+private:
+    /**
+     *  Structure of a single cached response
+     */
+    struct Entry
+    {
+        /**
+         *  The key under which it is stored
+         *  @var std::string
+         */
+        std::string key;
+
+        /**
+         *  The raw response (or the synthesized response for negative answers)
+         *  @var std::vector
+         */
+        std::vector<unsigned char> data;
+
+        /**
+         *  Offsets of the TTL fields in the raw response
+         *  @var std::vector
+         */
+        std::vector<uint16_t> ttls;
+
+        /**
+         *  Time when the response was stored, and when it expires
+         *  @var double
+         */
+        double stored;
+        double expires;
+
+        /**
+         *  Number of bytes that this entry accounts for
+         *  @return size_t
+         */
+        size_t bytes() const { return sizeof(Entry) + key.size() + data.size() + ttls.size() * sizeof(uint16_t); }
+    };
+
+    /**
+     *  All entries, the most recently used entry at the front
+     *  @var std::list
+     */
+    std::list<Entry> _entries;
+
+    /**
+     *  Index of the entries by their key
+     *  @var std::unordered_map
+     */
+    std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+
+    /**
+     *  The memory budget (zero means that the cache is disabled)
+     *  @var size_t
+     */
+    size_t _capacity = 0;
+
+    /**
+     *  Number of bytes in use
+     *  @var size_t
+     */
+    size_t _size = 0;
+
+    /**
+     *  Statistics
+     *  @var size_t
+     */
+    size_t _hits = 0;
+    size_t _misses = 0;
+    size_t _evictions = 0;
+
+    /**
+     *  Remove an entry
+     *  @param  iter        the entry to remove
+     */
+    void erase(std::list<Entry>::iterator iter);
+
+    /**
+     *  Evict entries until we are within the budget
+     */
+    void shrink();
+
+public:
+    /**
+     *  Constructor
+     */
+    Cache() = default;
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Cache(const Cache &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Cache() = default;
+
+    /**
+     *  Change the memory budget (set to zero to disable the cache)
+     *  @param  bytes       max number of bytes to use
+     */
+    void capacity(size_t bytes);
+
+    /**
+     *  The memory budget
+     *  @return size_t
+     */
+    size_t capacity() const { return _capacity; }
+
+    /**
+     *  Is the cache enabled?
+     *  @return bool
+     */
+    bool enabled() const { return _capacity > 0; }
+
+    /**
+     *  Number of bytes in use
+     *  @return size_t
+     */
+    size_t size() const { return _size; }
+
+    /**
+     *  Number of cached responses
+     *  @return size_t
+     */
+    size_t entries() const { return _entries.size(); }
+
+    /**
+     *  Number of queries that were answered from the cache, the number of queries that
+     *  could not be answered from the cache, and the number of evicted responses
+     *  @return size_t
+     */
+    size_t hits() const { return _hits; }
+    size_t misses() const { return _misses; }
+    size_t evictions() const { return _evictions; }
+
+    /**
+     *  Store a response in the cache (this is ignored for responses that can not be cached)
+     *  @param  query       the query that was sent
+     *  @param  response    the response that was received
+     *  @param  now         current time
+     *  @return bool        was the response stored?
+     */
+    bool add(const Query &query, const Response &response, double now);
+
+    /**
+     *  Look up the response for a query. On success, the response is copied into the
+     *  result buffer, with the ID of the query and with TTLs that are reduced by the
+     *  time that the response has been in the cache
+     *  @param  query       the query to look up
+     *  @param  now         current time
+     *  @param  result      buffer to which the response is copied
+     *  @return bool        was the response found?
+     */
+    bool fetch(const Query &query, double now, std::vector<unsigned char> &result);
+
+    /**
+     *  Remove all responses from the cache
+     */
+    void clear();
+};
+
+/**
+ *  End of namespace
+ */
+}
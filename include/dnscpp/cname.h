@@ -47,6 +47,17 @@ public:
         Extractor(record, TYPE_CNAME, 0), 
         _target(response, record.data()) {}
     
+    /**
+     *  Check if the constructor can be called without an exception (the name must be valid too)
+     *  @param  response
+     *  @param  record
+     *  @return bool
+     */
+    static bool valid(const Response &response, const Record &record)
+    {
+        return Extractor::valid(record, TYPE_CNAME, 0) && Wire::check(response.data(), response.end(), record.data()) != nullptr;
+    }
+
     /**
      *  Destructor
      */
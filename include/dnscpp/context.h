@@ -101,8 +101,7 @@ public:
     void sockets(size_t count)
     {
         // pass on
-        _ipv4.sockets(count);
-        _ipv6.sockets(count);
+        _sockets.sockets(count);
     }
     
     /**
@@ -125,6 +124,41 @@ public:
         _interval = std::max(interval, 0.1);
     }
     
+    /**
+     *  Use an adaptive interval before a datagram is sent again. Instead of the fixed interval,
+     *  the time to wait is then computed from the round trip times of the nameserver to which 
+     *  the previous datagram was sent (srtt + 4 * rttvar, just like TCP does), and doubled on 
+     *  every next attempt. The result is clamped between the min interval and the regular interval.
+     *  @param  adaptive    the new setting
+     */
+    void adaptive(bool adaptive) { _adaptive = adaptive; }
+    
+    /**
+     *  Set the lower limit of the adaptive interval
+     *  @param  interval    time in seconds
+     */
+    void mininterval(double interval)
+    {
+        // store property, make sure the numbers are reasonably clamped
+        _mininterval = std::max(interval, 0.001);
+    }
+    
+    /**
+     *  Enable hedged datagrams: when no response was received after a certain percentile
+     *  of the recently observed round trip times of a nameserver, the query is sent to a
+     *  second nameserver too (without waiting for the regular interval), and the first 
+     *  response wins. To make sure that this does not amplify the load during an outage,
+     *  the number of extra datagrams is limited to a fraction of the number of lookups.
+     *  @param  percentile  the percentile (for example 0.95), or zero to disable hedging
+     *  @param  budget      max fraction of extra datagrams
+     */
+    void hedging(double percentile, double budget = 0.05)
+    {
+        // store properties, make sure the numbers are reasonably clamped
+        _hedging = std::min(std::max(percentile, 0.0), 1.0);
+        _budget = std::min(std::max(budget, 0.0), 1.0);
+    }
+    
     /**
      *  Set the max number of attempts
      *  @param  attempt     max number of attemps
@@ -142,7 +176,64 @@ public:
     void buffersize(int32_t value);
 
     /**
-     *  Set the capacity: number of operations to run at the same time
+     *  Set the max number of datagrams that are received with one system call
+     *  A higher number means fewer system calls when many responses come in at once
+     *  @param  value       number of datagrams
+     */
+    void batchsize(size_t value);
+
+    /**
+     *  Attach a socket filter to the UDP sockets, so that the kernel already drops datagrams 
+     *  that can not be a response (not from port 53, too small, or not a response at all).
+     *  This is off by default. Datagrams that are dropped by the kernel are not included
+     *  in the dropped() counter.
+     *  @param  value       the new setting
+     */
+    void filter(bool value);
+
+    /**
+     *  Use a connected UDP socket for every nameserver. Queries are then sent with send()
+     *  instead of sendto(), and when the kernel reports that the nameserver port is closed
+     *  (an icmp port unreachable error) the nameserver is marked as failed and the lookups 
+     *  that were waiting for it immediately proceed with their next attempt. This is off 
+     *  by default. Sockets that are already in use are not affected.
+     *  @param  value       the new setting
+     */
+    void connected(bool value);
+
+    /**
+     *  Set the lifetime of the UDP sockets. By default, a socket is closed as soon as no more
+     *  responses are expected, and it is reopened (with a new source port) for the next query.
+     *  Under moderate load this means that sockets are opened and closed all the time. When you
+     *  set a limit, the sockets stay open instead, and they get a new port after the given 
+     *  number of queries or seconds. The responses that are still expected on the old port 
+     *  are received until the socket becomes idle, or until it gets yet another port (so the 
+     *  limits should not be too low compared to the timeout). A socket that has been idle for
+     *  the given number of seconds is closed anyway, because open sockets keep the event loop
+     *  running (a program that runs the loop until there is no more work would otherwise
+     *  never return). Zero keeps idle sockets open until the context is destructed.
+     *  @param  queries     max number of queries per port (zero for no limit)
+     *  @param  seconds     max number of seconds per port (zero for no limit)
+     *  @param  idle        number of seconds after which an idle socket is closed anyway
+     */
+    void lifetime(size_t queries, double seconds, double idle = 10.0);
+
+    /**
+     *  Keep TCP connections open after use. By default, a TCP connection (that is set up when a
+     *  response did not fit in a datagram) is closed as soon as the response was received, and
+     *  the next truncated response needs a new connection. When you set a pool size, unused 
+     *  connections (one per nameserver) are kept open for the given number of seconds, or
+     *  shorter if the nameserver announces a shorter timeout (with the edns-tcp-keepalive option).
+     *  Lookups use such an open connection right away.
+     *  @param  connections max number of unused connections to keep open (zero to disable)
+     *  @param  seconds     max number of seconds to keep an unused connection open
+     */
+    void pool(size_t connections, double seconds);
+
+    /**
+     *  Set the capacity: number of operations to run at the same time. Every socket
+     *  can handle 32768 operations, so for a higher capacity you also need more sockets.
+     *  In connected mode the capacity is at most 32768 (there is one socket per nameserver).
      *  @param  value       the new value
      */
     void capacity(size_t value);
@@ -158,12 +249,43 @@ public:
      *  @param rotate   the new setting
      */
     void rotate(bool rotate) { _rotate = rotate; }
+
+    /**
+     *  Set the transport policy. By default, queries are sent as datagrams, and tcp is only used
+     *  when a response was truncated. With Transport::tcp, all queries are sent over tcp, and with
+     *  Transport::adaptive this happens for nameservers that truncated a number of responses. 
+     *  Queries that are sent over tcp are not repeated after the interval, but only when the 
+     *  connection fails. Use this together with pool(), so that the connections are reused.
+     *  @param  transport   the new policy
+     *  @param  truncations number of truncated responses after which the adaptive policy switches to tcp
+     */
+    void transport(Transport transport, size_t truncations = 1) { _transport = transport; _threshold = std::max(size_t(1), truncations); }
     
     /**
      *  Set the max number of calls that are made to userspace in one iteration
      *  @param  value       the new value
      */
     void maxcalls(size_t value) { _maxcalls = value; }
+
+    /**
+     *  Set the memory budget of the response cache. By default the cache is disabled, 
+     *  and every query is sent to the nameservers. When you set a budget, responses are
+     *  cached (as long as their TTL allows) and the least recently used responses are
+     *  evicted when the budget is exceeded. Set to zero to disable the cache again.
+     *  @param  bytes       max number of bytes to use for the cache
+     */
+    void cache(size_t bytes) { _cache.capacity(bytes); }
+
+    /**
+     *  Set the size of the memory of truncated responses. When a nameserver sends a truncated
+     *  response, the question is remembered, and a next lookup for the same question is sent to
+     *  that nameserver over tcp right away (without first sending a datagram that would be truncated
+     *  again). By default 1024 questions are remembered for 300 seconds. Set to zero to disable this.
+     *  The number of round trips that were saved is available via truncations().saved().
+     *  @param  entries     max number of questions to remember
+     *  @param  seconds     number of seconds that a question is remembered
+     */
+    void truncations(size_t entries, double seconds) { _truncations.capacity(entries, seconds); }
     
     /**
      *  Do a dns lookup and pass the result to a user-space handler object
@@ -216,9 +338,17 @@ public:
      */
     using Core::bits;
     using Core::rotate;
+    using Core::transport;
     using Core::expire;
     using Core::interval;
+    using Core::adaptive;
+    using Core::mininterval;
+    using Core::hedging;
     using Core::capacity;
+    using Core::cache;
+    using Core::truncations;
+    using Core::nameservers;
+    using Core::dropped;
 };
     
 /**
@@ -26,10 +26,14 @@
 #include "lookup.h"
 #include "processor.h"
 #include "timer.h"
-#include <list>
-#include <deque>
-#include <memory>
+#include "wheel.h"
+#include "cache.h"
+#include "truncations.h"
+#include "nameserver.h"
+#include "transport.h"
 #include <cassert>
+#include <string>
+#include <unordered_map>
 
 /**
  *  Begin of namespace
@@ -40,6 +44,8 @@ namespace DNS {
  *  Forward declarations
  */
 class Loop;
+class Handler;
+class RemoteLookup;
 
 /**
  *  Class definition
@@ -54,19 +60,16 @@ protected:
     Loop *_loop;
 
     /**
-     *  Collection of sockets (we need two for ipv4 and ipv6 traffic)
+     *  Collection of sockets (these are dual-stack, so they are used for ipv4 and ipv6 traffic)
      *  @var Sockets
-     * 
-     *  @todo this is stupid
      */
-    Sockets _ipv4;
-    Sockets _ipv6;
+    Sockets _sockets;
 
     /**
-     *  The IP addresses of the servers that can be accessed
-     *  @var std::vector<Ip>
+     *  The servers that can be accessed (with statistics about their health)
+     *  @var std::vector<Nameserver>
      */
-    std::vector<Ip> _nameservers;
+    std::vector<Nameserver> _nameservers;
     
     /**
      *  The contents of the /etc/hosts file
@@ -75,40 +78,102 @@ protected:
     Hosts _hosts;
 
     /**
-     *  All operations that are in progress and that are waiting for the next 
-     *  (possibly first) attempt. Note that we use multiple queues so that we do
-     *  not have to use a slow (priority) queue.
-     *  @var std::deque<std::shared_ptr<Lookup>>
+     *  Cache with responses (only used when it has a capacity)
+     *  @var Cache
+     */
+    Cache _cache;
+
+    /**
+     *  Questions for which nameservers recently sent truncated responses
+     *  @var Truncations
      */
-    std::deque<std::shared_ptr<Lookup>> _lookups;
+    Truncations _truncations;
+
+    /**
+     *  Remote lookups that are in progress, indexed by the fingerprint of their query, so 
+     *  that identical queries can share the same lookup instead of sending their own datagrams
+     *  @var std::unordered_map
+     */
+    std::unordered_map<std::string, RemoteLookup*> _shared;
+
+    /**
+     *  All operations that are in progress, stored in a timing wheel that is keyed
+     *  on the time at which each lookup needs attention (to send out a next datagram,
+     *  or to time out). The core owns these lookups.
+     *  @var Wheel
+     */
+    Wheel _lookups;
     
     /**
      *  To avoid that external DNS servers, or our own response-buffer, is flooded
      *  with data, there is a limit on the number of operations that can run. If
-     *  there are more operations than we can handle, this buffer is used for 
+     *  there are more operations than we can handle, this list is used for 
      *  overflow (is not supposed to happen often!)
-     *  @var std::deque<std::shared_ptr<Lookup>>
+     *  @var Wheel::List
      */
-    std::deque<std::shared_ptr<Lookup>> _scheduled;
+    Wheel::List _scheduled;
     
     /**
-     *  Lookups for which the max number of attempts have been reached (no further
-     *  messages will be sent) and that are waiting for response or expiration
-     *  @var std::deque<std::shared_ptr<Lookup>>
+     *  Lookups that have reported their result to userspace, and that are going to
+     *  be destructed as soon as we are sure that they are no longer on the stack
+     *  @var Wheel::List
      */
-    std::deque<std::shared_ptr<Lookup>> _ready;
+    Wheel::List _finished;
+    
+    /**
+     *  Helper class for a timer that expires right away. We use a separate timer for this,
+     *  so that the regular timer does not have to be reset every time a socket becomes active
+     */
+    class Immediate : public Timer
+    {
+    private:
+        /**
+         *  The core that is notified
+         *  @var Core
+         */
+        Core *_core;
+        
+        /**
+         *  Notify the timer that it expired
+         */
+        virtual void expire() override;
+        
+    public:
+        /**
+         *  Constructor
+         *  @param  core
+         */
+        Immediate(Core *core) : _core(core) {}
+        
+        /**
+         *  Destructor
+         */
+        virtual ~Immediate() = default;
+    };
     
     /**
-     *  The next timer to run
+     *  The next timer to run (for the first lookup in the wheel)
      *  @var void *
      */
     void *_timer = nullptr;
     
     /**
-     *  Is the timer expected to expire right away
-     *  @var bool
+     *  The time for which the timer was set
+     *  @var double
+     */
+    double _expires = 0.0;
+    
+    /**
+     *  The timer that expires right away (when sockets have data available, or when there is other work to do)
+     *  @var void *
+     */
+    void *_immediate = nullptr;
+    
+    /**
+     *  The object that is notified when the immediate timer expires
+     *  @var Immediate
      */
-    double _immediate = false;
+    Immediate _trigger;
 
     /**
      *  Max time that we wait for a response
@@ -128,6 +193,33 @@ protected:
      */
     double _interval = 2.0;
     
+    /**
+     *  Should the interval be computed from the round trip times of the nameservers?
+     *  @var bool
+     */
+    bool _adaptive = false;
+    
+    /**
+     *  Lower limit for the adaptive interval
+     *  @var double
+     */
+    double _mininterval = 0.02;
+    
+    /**
+     *  Percentile of the round trip times after which a hedged datagram is sent to
+     *  a second nameserver (zero when hedging is disabled)
+     *  @var double
+     */
+    double _hedging = 0.0;
+    
+    /**
+     *  The budget for hedged datagrams: the max fraction of extra datagrams, and the
+     *  number of hedged datagrams that can be sent right now (a token bucket)
+     *  @var double
+     */
+    double _budget = 0.05;
+    double _tokens = 0.0;
+    
     /**
      *  Default bits to include in queries
      *  @var Bits
@@ -139,6 +231,14 @@ protected:
      *  @var bool
      */
     bool _rotate = false;
+
+    /**
+     *  The transport policy, and the number of truncated responses after which the adaptive policy switches to tcp
+     *  @var Transport
+     *  @var size_t
+     */
+    Transport _transport = Transport::udp;
+    size_t _threshold = 1;
     
     /**
      *  Max number of operations to run at the same time
@@ -159,16 +259,30 @@ protected:
     size_t _inflight = 0;
 
     /**
-     *  Calculate the delay until the next job
-     *  @return double      the delay in seconds (or < 0 if there is no need to run a timer)
+     *  Calculate the time of the next job
+     *  @param  now         current time
+     *  @return double      the time (or < 0 if there is no need to run a timer)
+     */
+    double next(double now) const;
+
+    /**
+     *  Set the timers to a certain time
+     *  @param  now         current time
+     *  @param  expires     time at which the timer should expire (or < 0 if no timer is needed)
+     */
+    void timer(double now, double expires);
+
+    /**
+     *  Store a lookup in the wheel, based on the time of its next step
+     *  @param  lookup      the lookup to store
+     *  @param  now         current time
      */
-    double delay(double now);
+    void schedule(Lookup *lookup, double now);
 
     /**
-     *  Set the timer to a certain period
-     *  @param  seconds     expire time
+     *  Destruct the lookups that have finished
      */
-    void timer(double seconds);
+    void purge();
 
     /**
      *  Proceed with more operations
@@ -184,7 +298,12 @@ protected:
      *  @param  now         current time
      *  @return bool        was this lookup indeed processable (false if processed too early)
      */
-    bool process(const Watcher &watcher, const std::shared_ptr<Lookup> &lookup, double now);
+    bool process(const Watcher &watcher, Lookup *lookup, double now);
+
+    /**
+     *  Run all jobs that should run now
+     */
+    void run();
 
     /**
      *  Notify the timer that it expired
@@ -228,7 +347,7 @@ protected:
     void onActive(Sockets *sockets) override;
 
     /**
-     *  Method that is called when a UDP socket has a buffer that it wants to deliver
+     *  Reset the timer, in case the first job was moved forward
      *  @param  now         current time
      */
     void reschedule(double now);
@@ -253,6 +372,46 @@ public:
      */
     double interval() const { return _interval; }
     
+    /**
+     *  Is the interval computed from the round trip times of the nameservers? In that
+     *  case interval() is the upper limit, and mininterval() the lower limit
+     *  @return bool
+     */
+    bool adaptive() const { return _adaptive; }
+    
+    /**
+     *  Lower limit for the adaptive interval
+     *  @return double
+     */
+    double mininterval() const { return _mininterval; }
+    
+    /**
+     *  Percentile of the round trip times after which a hedged datagram is sent (zero when disabled)
+     *  @return double
+     */
+    double hedging() const { return _hedging; }
+    
+    /**
+     *  Register that a lookup is started, which adds a little bit to the budget for hedged datagrams
+     */
+    void earn() { _tokens = std::min(_tokens + _budget, 10.0); }
+    
+    /**
+     *  Spend part of the budget on a hedged datagram
+     *  @return bool            was there enough budget?
+     */
+    bool spend()
+    {
+        // there must be enough budget left
+        if (_tokens < 1.0) return false;
+
+        // spend it
+        _tokens -= 1.0;
+
+        // done
+        return true;
+    }
+    
     /**
      *  The time to wait for a response
      *  @return double
@@ -266,10 +425,11 @@ public:
     size_t attempts() const { return _attempts; }
     
     /**
-     *  THe capacity: number of operations to run at the same time
+     *  THe capacity: number of operations to run at the same time (this is limited
+     *  by the number of sockets, because each socket has a limited number of IDs)
      *  @return size_t
      */
-    size_t capacity() const { return _capacity; }
+    size_t capacity() const { return std::min(_capacity, _sockets.capacity()); }
     
     /**
      *  Default bits that are sent with each query
@@ -283,6 +443,27 @@ public:
      */
     bool rotate() const { return _rotate; }
 
+    /**
+     *  The transport policy
+     *  @return Transport
+     */
+    Transport transport() const { return _transport; }
+
+    /**
+     *  Should queries to a nameserver be sent over tcp right away (without trying a datagram first)?
+     *  @param  nameserver      the nameserver
+     *  @return bool
+     */
+    bool stream(const Nameserver &nameserver) const
+    {
+        // this depends on the policy
+        switch (_transport) {
+        case Transport::tcp:        return true;
+        case Transport::adaptive:   return nameserver.truncations() >= _threshold;
+        default:                    return false;
+        }
+    }
+
     /**
      *  Does a certain hostname exists in /etc/hosts? In that case a NXDOMAIN error should not be given
      *  @param  hostname        hostname to check
@@ -291,12 +472,90 @@ public:
     bool exists(const char *hostname) const { return _hosts.lookup(hostname) != nullptr; }
 
     /**
-     *  Send a message over a UDP socket
+     *  Expose the cache (to check the statistics)
+     *  @return Cache
+     */
+    const Cache &cache() const { return _cache; }
+
+    /**
+     *  Store a response in the cache (if the cache is enabled and the response can be cached)
+     *  @param  query           the query that was sent
+     *  @param  response        the response that was received
+     */
+    void remember(const Query &query, const Response &response) { if (_cache.enabled()) _cache.add(query, response, Now()); }
+
+    /**
+     *  Expose the memory of truncated responses (to check the statistics)
+     *  @return Truncations
+     */
+    const Truncations &truncations() const { return _truncations; }
+
+    /**
+     *  Remember that a nameserver sent a truncated response to a question
+     *  @param  ip              address of the nameserver
+     *  @param  fingerprint     fingerprint of the question
+     */
+    void truncated(const Ip &ip, const std::string &fingerprint) { _truncations.add(ip, fingerprint, Now()); }
+
+    /**
+     *  Did a nameserver recently send a truncated response to a question? (the lookup then uses tcp right away)
+     *  @param  ip              address of the nameserver
+     *  @param  fingerprint     fingerprint of the question
+     *  @param  now             current time
+     *  @return bool
+     */
+    bool truncated(const Ip &ip, const std::string &fingerprint, double now) { return _truncations.contains(ip, fingerprint, now); }
+
+    /**
+     *  Forget that a nameserver sent a truncated response to a question (a next lookup uses a datagram again)
+     *  @param  ip              address of the nameserver
+     *  @param  fingerprint     fingerprint of the question
+     */
+    void untruncated(const Ip &ip, const std::string &fingerprint) { _truncations.remove(ip, fingerprint); }
+
+    /**
+     *  Count a lookup that went to tcp right away because of an earlier truncated response (a saved round trip)
+     */
+    void saved() { _truncations.save(); }
+
+    /**
+     *  Forget about a remote lookup that could be shared (because it finished)
+     *  @param  fingerprint     fingerprint of the query
+     *  @param  lookup          the lookup that is no longer available
+     */
+    void unshare(const std::string &fingerprint, RemoteLookup *lookup)
+    {
+        // look up the lookup
+        auto iter = _shared.find(fingerprint);
+        
+        // only remove it if it is still the same lookup
+        if (iter != _shared.end() && iter->second == lookup) _shared.erase(iter);
+    }
+
+    /**
+     *  Hand over a lookup that was waiting for an other lookup (and that is therefore not yet
+     *  known to the core), its result is reported to userspace in the next iteration
+     *  @param  lookup          the lookup that is ready
+     */
+    void resume(Lookup *lookup) { add(lookup); }
+
+    /**
+     *  Make sure that the next step of a lookup that is in progress is taken right away,
+     *  this is used when a lookup learns that it no longer has to wait
+     *  @param  lookup          the lookup that should run
+     */
+    void expedite(Lookup *lookup);
+
+    /**
+     *  Send a message over a UDP socket. The sockets pick the ID of the datagram (this is 
+     *  an ID that is not yet in use on that socket for that nameserver), so the lookup should
+     *  subscribe with that ID and not with the ID of the query.
      *  @param  ip              target IP
      *  @param  query           the query to send
+     *  @param  id              the ID with which the query was sent (output parameter)
      *  @return Inbound         the object that receives the answer
      */
-    Inbound *datagram(const Ip &ip, const Query &query);
+    Inbound *datagram(const Ip &ip, const Query &query, uint16_t &id);
 
     /**
      *  Connect with TCP to a socket
@@ -307,18 +566,54 @@ public:
      */
     Connecting *connect(const Ip &ip, Connector *connector);
 
+    /**
+     *  Find an established TCP connection to a nameserver (that can be used right away)
+     *  @param  ip              IP address of the nameserver
+     *  @return Tcp             the connection, or nullptr if there is none
+     */
+    Tcp *established(const Ip &ip) { return _sockets.established(ip); }
+
+    /**
+     *  Number of received datagrams that were dropped because they were not a response to 
+     *  one of our queries (late duplicates, or spoofing attempts)
+     *  @return size_t
+     */
+    size_t dropped() const { return _sockets.dropped(); }
+
     /**
      *  Expose the nameservers
-     *  @return std::list<Ip>
+     *  @return std::vector<Nameserver>
      */
-    const std::vector<Ip> &nameservers() const { return _nameservers; }
+    const std::vector<Nameserver> &nameservers() const { return _nameservers; }
+
+    /**
+     *  Find a nameserver by its address (to update its statistics)
+     *  @param  ip              address of the nameserver
+     *  @return Nameserver      the nameserver, or nullptr if it is not (or no longer) in use
+     */
+    Nameserver *find(const Ip &ip)
+    {
+        // check all nameservers (there are normally just a few)
+        for (auto &nameserver : _nameservers) if (nameserver.ip() == ip) return &nameserver;
+        
+        // not found
+        return nullptr;
+    }
     
     /**
-     *  Mark a lookup as cancelled and start more queues lookups
-     *  This is called internally when userspace cancels a single operation (via Operation::cancel())
+     *  Mark a lookup as finished: it no longer needs timers, and it is destructed as soon
+     *  as possible. This is called internally by the lookup right before it reports its result.
      *  @param  lookup
      */
-    void cancel(const Lookup *lookup);
+    void done(Lookup *lookup);
+    
+    /**
+     *  Report to userspace that a lookup was cancelled, and destruct it right away
+     *  This is called internally when userspace cancels a single operation (via Operation::cancel())
+     *  @param  lookup      the lookup that was cancelled (and on which done() was already called)
+     *  @param  handler     the user space handler to notify
+     */
+    void cancel(Lookup *lookup, DNS::Handler *handler);
 };
 
 /**
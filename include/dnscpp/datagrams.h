@@ -0,0 +1,156 @@
+/**
+ *  Datagrams.h
+ *
+ *  Internal class with a set of preallocated slots in which multiple
+ *  datagrams can be received with a single recvmmsg() system call. This
+ *  is used by the UDP sockets to drain their receive buffer in batches.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "query.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Datagrams
+{
+private:
+    /**
+     *  One big buffer that holds the data of all slots
+     *  @var std::vector
+     */
+    std::vector<unsigned char> _buffer;
+
+    /**
+     *  The message headers that are passed to recvmmsg()
+     *  @var std::vector
+     */
+    std::vector<struct mmsghdr> _headers;
+
+    /**
+     *  The io-vectors that point into the buffer
+     *  @var std::vector
+     */
+    std::vector<struct iovec> _iovecs;
+
+    /**
+     *  Source addresses (we use an ipv6 struct because that is also big enough for ipv4)
+     *  @var std::vector
+     */
+    std::vector<struct sockaddr_in6> _addresses;
+
+public:
+    /**
+     *  Constructor
+     *  @param  slots       number of datagrams that can be received in one call
+     */
+    Datagrams(size_t slots = 1) { resize(slots); }
+
+    /**
+     *  No copying (the headers hold pointers into our own buffers)
+     *  @param  that
+     */
+    Datagrams(const Datagrams &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Datagrams() = default;
+
+    /**
+     *  Change the number of slots
+     *  @param  slots       the new number of slots
+     */
+    void resize(size_t slots)
+    {
+        // we need at least one slot
+        slots = std::max(slots, size_t(1));
+
+        // allocate all the memory
+        _buffer.resize(slots * EDNSPacketSize);
+        _headers.resize(slots);
+        _iovecs.resize(slots);
+        _addresses.resize(slots);
+
+        // link the structures to each other
+        for (size_t i = 0; i < slots; ++i)
+        {
+            // the io-vector points to a part of the buffer
+            _iovecs[i].iov_base = _buffer.data() + i * EDNSPacketSize;
+            _iovecs[i].iov_len = EDNSPacketSize;
+
+            // and the header refers to the io-vector and the address
+            memset(&_headers[i], 0, sizeof(struct mmsghdr));
+            _headers[i].msg_hdr.msg_iov = &_iovecs[i];
+            _headers[i].msg_hdr.msg_iovlen = 1;
+            _headers[i].msg_hdr.msg_name = &_addresses[i];
+        }
+    }
+
+    /**
+     *  Number of slots
+     *  @return size_t
+     */
+    size_t capacity() const { return _headers.size(); }
+
+    /**
+     *  Receive as many datagrams as possible (without blocking)
+     *  @param  fd          the socket to read from
+     *  @return int         number of received datagrams, or -1 on failure
+     */
+    int receive(int fd)
+    {
+        // the kernel overwrites the address lengths, so we have to reset them
+        for (auto &header : _headers) header.msg_hdr.msg_namelen = sizeof(struct sockaddr_in6);
+
+        // receive the messages
+        return recvmmsg(fd, _headers.data(), _headers.size(), MSG_DONTWAIT, nullptr);
+    }
+
+    /**
+     *  The source address of a received datagram
+     *  @param  index       slot number
+     *  @return sockaddr
+     */
+    const struct sockaddr *address(size_t index) const { return (const struct sockaddr *)&_addresses[index]; }
+
+    /**
+     *  The data of a received datagram
+     *  @param  index       slot number
+     *  @return unsigned char *
+     */
+    const unsigned char *data(size_t index) const { return _buffer.data() + index * EDNSPacketSize; }
+
+    /**
+     *  Size of a received datagram
+     *  @param  index       slot number
+     *  @return size_t
+     */
+    size_t size(size_t index) const { return _headers[index].msg_len; }
+};
+
+/**
+ *  End of namespace
+ */
+}
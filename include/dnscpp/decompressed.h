@@ -15,6 +15,13 @@
  */
 #pragma once
 
+/**
+ *  Dependencies
+ */
+#include "wire.h"
+#include <stdexcept>
+#include <string.h>
+
 /**
  *  Begin of namespace
  */
@@ -50,14 +57,10 @@ public:
      *  @param  data        the data buffer where the name begins
      *  @throws std::runtime_error
      */
-    Decompressed(const unsigned char *begin, const unsigned char *end, const unsigned char *data) :
-        _bytes(ns_name_uncompress(begin, end, data, _name, MAXDNAME))
+    Decompressed(const unsigned char *begin, const unsigned char *end, const unsigned char *data)
     {
         // check for success
-        if (_bytes < 0) std::runtime_error("failed to decompress name");
-
-        // the ns_name_uncompress() method has special handling for the root-domain which we want to roll back
-        if (_name[0] == '.') _name[0] = '\0';
+        if (!parse(begin, end, data)) throw std::runtime_error("failed to decompress name");
     }
 
     /**
@@ -71,11 +74,39 @@ public:
     Decompressed(const Response &response, const unsigned char *data) :
         Decompressed(response.data(), response.end(), data) {}
     
+    /**
+     *  Constructor for an empty name, call parse() to fill it (this does not throw)
+     */
+    Decompressed() : _bytes(0) { _name[0] = '\0'; }
+    
     /**
      *  Destructor
      */
     virtual ~Decompressed() = default;
     
+    /**
+     *  Decompress a name. This is the alternative for the constructor that does not throw.
+     *  The parameters are the same as for the constructor.
+     *  @param  begin       begin of the full response buffer
+     *  @param  end         end of the full response buffer
+     *  @param  data        the data buffer where the name begins
+     *  @return bool        false if the name is malformed (the object then holds an empty name)
+     */
+    bool parse(const unsigned char *begin, const unsigned char *end, const unsigned char *data)
+    {
+        // decompress the name
+        _bytes = Wire::expand(begin, end, data, _name, MAXDNAME);
+        
+        // check for success
+        if (_bytes >= 0) return true;
+        
+        // make the object empty
+        _name[0] = '\0'; _bytes = 0;
+        
+        // report the failure
+        return false;
+    }
+    
     /**
      *  Cast to a const char *
      *  @return const char *
@@ -44,6 +44,13 @@ public:
      */
     DNSKEY(const Response &response, const Record &record) : Extractor(record, TYPE_DNSKEY, 4) {}
     
+    /**
+     *  Check if the constructor can be called without an exception
+     *  @param  record
+     *  @return bool
+     */
+    static bool valid(const Record &record) { return Extractor::valid(record, TYPE_DNSKEY, 4); }
+
     /**
      *  Destructor
      */
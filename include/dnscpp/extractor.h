@@ -61,6 +61,19 @@ protected:
         if (record.size() < size) throw std::runtime_error("record too small");
     }
 
+    /**
+     *  Check if a record can be passed to the constructor without an exception. Derived
+     *  classes have a public static valid() method that calls this and does their own checks.
+     *  @param  record  the record from which data is to be extracted
+     *  @param  type    the required type
+     *  @param  size    the minimal required size
+     *  @return bool
+     */
+    static bool valid(const Record &record, ns_type type, size_t size)
+    {
+        return record.type() == type && record.size() >= size;
+    }
+
     /**
      *  May not be copied to user-space (because a reference to _record is stored)
      *  @param  other
@@ -21,10 +21,9 @@
 /**
  *  Dependencies
  */
-#include <set>
 #include <stdint.h>
-#include <tuple>
 #include "ip.h"
+#include "processors.h"
 
 /**
  *  Begin of namespace
@@ -43,10 +42,11 @@ class Inbound
 {
 protected:
     /**
-     *  Set with the handlers (we originally used a multimap, but a std::set turned out to be more efficient)
-     *  @var set
+     *  Table with the handlers (we originally used a multimap, then a std::set, but
+     *  a flat hash table indexed by the query ID turned out to be more efficient)
+     *  @var Processors
      */
-    std::set<std::tuple<uint16_t,Ip,Processor*>> _processors;
+    Processors _processors;
 
     /**
      *  Constructor
@@ -78,8 +78,9 @@ public:
      *  @param  processor   the object that no longer is active
      *  @param  ip          the IP to which it was listening to
      *  @param  id          the query ID in which it was interested
+     *  @param  original    the ID of the original query (responses are passed on with this ID)
      */
-    void subscribe(Processor *processor, const Ip &ip, uint16_t id);
+    void subscribe(Processor *processor, const Ip &ip, uint16_t id, uint16_t original);
 
     /**
      *  Unsubscribe (counter-part of the subscribe method above)
@@ -0,0 +1,191 @@
+/**
+ *  Inbox.h
+ *
+ *  Internal class with the responses that were received by a socket, and
+ *  that are waiting to be processed. This is the counterpart of the Outbox.
+ *  The responses are stored in a ring of slots, and every slot keeps its
+ *  buffer when the response is processed, so that no memory has to be
+ *  allocated for the next responses (once the ring is big enough).
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <vector>
+#include <algorithm>
+#include "query.h"
+#include "ip.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Inbox
+{
+private:
+    /**
+     *  A slot in the ring
+     */
+    struct Slot
+    {
+        /**
+         *  Address from which the response was received
+         *  @var Ip
+         */
+        Ip ip;
+
+        /**
+         *  The response (the buffer is reused for later responses)
+         *  @var std::vector
+         */
+        std::vector<unsigned char> buffer;
+    };
+
+    /**
+     *  The ring with all slots
+     *  @var std::vector
+     */
+    std::vector<Slot> _slots;
+
+    /**
+     *  The slot with the oldest response, and the number of responses in the ring
+     *  @var size_t
+     */
+    size_t _first = 0;
+    size_t _size = 0;
+
+    /**
+     *  Find the slot for the next response (the ring grows when it is full)
+     *  @return Slot
+     */
+    Slot &next()
+    {
+        // if the ring is full, it gets twice as big
+        if (_size == _slots.size())
+        {
+            // the new ring, the responses are moved to the start of it
+            std::vector<Slot> slots(std::max(_slots.size() * 2, size_t(16)));
+
+            // move the slots (including the buffers of the free slots)
+            for (size_t i = 0; i < _slots.size(); ++i) std::swap(slots[i], _slots[(_first + i) % _slots.size()]);
+
+            // install the new ring
+            _slots.swap(slots); _first = 0;
+        }
+
+        // the slot after the last response
+        return _slots[(_first + _size++) % _slots.size()];
+    }
+
+public:
+    /**
+     *  Constructor
+     */
+    Inbox() = default;
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Inbox(const Inbox &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Inbox() = default;
+
+    /**
+     *  Add a response that is copied into a free slot (slots are big enough for a full
+     *  datagram, so this does not allocate once the slot has been used before)
+     *  @param  ip          address from which the response was received
+     *  @param  data        the response data
+     *  @param  size        size of the data
+     */
+    void add(const Ip &ip, const unsigned char *data, size_t size)
+    {
+        // the slot to use
+        auto &slot = next();
+
+        // the first time that the slot is used, we allocate enough for every datagram
+        if (slot.buffer.capacity() < size) slot.buffer.reserve(std::max(size, EDNSPacketSize));
+
+        // copy the data
+        slot.ip = ip;
+        slot.buffer.assign(data, data + size);
+    }
+
+    /**
+     *  Add a response that is already in a buffer. The buffers are swapped, so the buffer
+     *  that is passed in gets the (empty) buffer of the slot, that can be used for the next response
+     *  @param  ip          address from which the response was received
+     *  @param  buffer      the response data
+     */
+    void add(const Ip &ip, std::vector<unsigned char> &buffer)
+    {
+        // the slot to use
+        auto &slot = next();
+
+        // take over the data
+        slot.ip = ip;
+        slot.buffer.swap(buffer);
+
+        // the caller gets an empty buffer (that may still have capacity)
+        buffer.clear();
+    }
+
+    /**
+     *  Remove the oldest response. The buffers are swapped: the caller gets the buffer with
+     *  the response, and the slot gets the buffer that was passed in (its content is not used,
+     *  but its capacity is used for later responses).
+     *  @param  ip          address from which the response was received (output parameter)
+     *  @param  buffer      buffer that is filled with the response
+     *  @return bool        false if there were no responses
+     */
+    bool pop(Ip &ip, std::vector<unsigned char> &buffer)
+    {
+        // is there anything?
+        if (_size == 0) return false;
+
+        // the oldest slot
+        auto &slot = _slots[_first];
+
+        // expose the data
+        ip = slot.ip;
+        buffer.swap(slot.buffer);
+
+        // the slot is now free
+        _first = (_first + 1) % _slots.size(); _size -= 1;
+
+        // done
+        return true;
+    }
+
+    /**
+     *  Is the inbox empty?
+     *  @return bool
+     */
+    bool empty() const { return _size == 0; }
+
+    /**
+     *  Number of responses in the inbox
+     *  @return size_t
+     */
+    size_t size() const { return _size; }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -17,6 +17,7 @@
  *  Dependencies
  */
 #include "operation.h"
+#include "wheel.h"
 
 /**
  *  Begin of namespace
@@ -28,11 +29,12 @@ namespace DNS {
  */
 class Handler;
 class Core;
+class Response;
 
 /**
  *  Class definition
  */
-class Lookup : public Operation
+class Lookup : public Operation, public Wheel::Entry
 {
 protected:
     /**
@@ -49,6 +51,23 @@ protected:
     Lookup(Core *core, Handler *handler, int op, const char *dname, int type, const Bits &bits, const unsigned char *data = nullptr) :
         Operation(core, handler, op, dname, type, bits, data) {}
 
+    /**
+     *  Constructor for a query that was already constructed
+     *  @param  core        the core object
+     *  @param  handler     user space handler
+     *  @param  query       the query to send
+     */
+    Lookup(Core *core, Handler *handler, const Query &query) :
+        Operation(core, handler, query) {}
+
+    /**
+     *  Pass a response to userspace. NXDOMAIN responses for hostnames that do 
+     *  exist in /etc/hosts are turned into an empty response first
+     *  @param  handler     the user space handler
+     *  @param  response    the response to report
+     */
+    void deliver(Handler *handler, const Response &response);
+
 public:
     /**
      *  Destructor
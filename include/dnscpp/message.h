@@ -17,9 +17,13 @@
 /**
  *  Dependencies
  */
+#include "wire.h"
 #include <arpa/nameser.h>
 #include <stdexcept>
 #include <string.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
 
 /**
  *  Begin of namespace
@@ -44,7 +48,75 @@ private:
      */
     ns_msg _handle;
 
+    /**
+     *  Position of a record in the message: the offset of its name, and the offset of 
+     *  the fixed fields right after the name (type, class, ttl and rdlength)
+     */
+    struct Position
+    {
+        uint16_t name;
+        uint16_t fields;
+    };
+
+    /**
+     *  Index with the positions of all records (in all sections), this is built when the
+     *  message is parsed, so that records can be looked up without walking the message again.
+     *  The positions of the first records are stored in the object itself (most messages are 
+     *  small), the rest in a vector.
+     *  @var Position[]
+     *  @var std::vector<Position>
+     */
+    Position _positions[16];
+    std::vector<Position> _overflow;
+
+    /**
+     *  The result code (including the extended bits from the OPT record), or -1 if not yet known
+     *  @var int
+     */
+    mutable int _rcode = -1;
+
+    /**
+     *  Parse the message: fill the handle and the index (the members must be empty)
+     *  @param  buffer      the raw data
+     *  @param  size        size of the buffer
+     *  @return bool
+     */
+    bool index(const unsigned char *buffer, size_t size)
+    {
+        // offsets in the index are stored in 16 bits (which is the max size of a message anyway)
+        if (size > UINT16_MAX) return false;
+        
+        // the header must at least fit to know the number of records
+        if (size < HFIXEDSZ) return false;
+        
+        // number of records according to the header, but every record takes at least five bytes,
+        // so we do not allocate more than that (to protect against bogus headers)
+        size_t total = ns_get16(buffer + 4) + ns_get16(buffer + 6) + ns_get16(buffer + 8) + ns_get16(buffer + 10);
+        
+        // allocate all memory at once (if the records do not fit in the object itself)
+        size_t capacity = std::min(total, (size - HFIXEDSZ) / 5);
+        if (capacity > 16) _overflow.reserve(capacity - 16);
+        
+        // number of records seen so far
+        size_t count = 0;
+        
+        // parse the message, and remember the positions of the records
+        return Wire::parse(buffer, size, _handle, [this, buffer, &count](const unsigned char *name, const unsigned char *fields) {
+            
+            // the position of the record
+            Position position{ uint16_t(name - buffer), uint16_t(fields - buffer) };
+            
+            // store it in the object, or in the vector
+            if (count < 16) _positions[count++] = position; else _overflow.push_back(position);
+        });
+    }
+
 protected:
+    /**
+     *  Constructor for an empty message (it has no records until parse() is called)
+     */
+    Message() { memset(&_handle, 0, sizeof(_handle)); }
+
     /**
      *  Constructor
      *  @param  buffer      the raw data that we received
@@ -54,7 +126,7 @@ protected:
     Message(const unsigned char *buffer, size_t size) 
     {
         // try parsing the buffer
-        if (ns_initparse(buffer, size, &_handle) == 0) return;
+        if (index(buffer, size)) return;
         
         // on failure we report an error
         throw std::runtime_error("failed to parse dns message");
@@ -75,7 +147,7 @@ protected:
         memcpy(_buffer, that.data(), that.size());
         
         // try parsing the buffer
-        if (ns_initparse(_buffer, that.size(), &_handle) == 0) return;
+        if (index(_buffer, that.size())) return;
         
         // on failure we report an error
         throw std::runtime_error("failed to parse dns message");
@@ -90,6 +162,29 @@ public:
         // deallocate optional buffer
         if (_buffer) free(_buffer);
     }
+
+    /**
+     *  Parse a buffer into this message. This is the alternative for the constructor that does 
+     *  not throw: on failure the message is emptied (it has no records). The buffer is not copied,
+     *  so it must remain valid for as long as the message is in use.
+     *  @param  buffer      the raw data that we received
+     *  @param  size        size of the buffer
+     *  @return bool        false if the message is malformed
+     */
+    bool parse(const unsigned char *buffer, size_t size)
+    {
+        // forget the previous message
+        _overflow.clear(); _rcode = -1;
+
+        // try parsing the message
+        if (index(buffer, size)) return true;
+
+        // make the message empty, so that it can still safely be used
+        memset(&_handle, 0, sizeof(_handle));
+
+        // report the failure
+        return false;
+    }
     
     /**
      *  Get the internal handle
@@ -221,7 +316,19 @@ public:
      *  @param  dnsclass    the dnsclass
      *  @return uint16_t
      */
-    uint16_t records(ns_sect section, uint16_t type, uint16_t dnsclass = ns_c_in);
+    uint16_t records(ns_sect section, uint16_t type, uint16_t dnsclass = ns_c_in) const;
+
+    /**
+     *  Find the position of a record in the message. This method is used internally by the
+     *  Record class, and returns pointers to the name of the record, and to the fixed fields
+     *  right after the name (type, class, and for non-question records the ttl and rdlength)
+     *  @param  section     the type of section
+     *  @param  index       the record-number inside the section
+     *  @param  name        pointer to the name (output parameter)
+     *  @param  fields      pointer to the fixed fields (output parameter)
+     *  @return bool        does the record exist?
+     */
+    bool locate(ns_sect section, size_t index, const unsigned char *&name, const unsigned char *&fields) const;
 
     /**
      *  Methods to return the number of records in one specific section
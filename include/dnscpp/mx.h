@@ -47,6 +47,17 @@ public:
         Extractor(record, TYPE_MX, 2),
         _target(response, record.data() + 2)  {} // first two bytes of the priority are skipped
     
+    /**
+     *  Check if the constructor can be called without an exception (the name must be valid too)
+     *  @param  response
+     *  @param  record
+     *  @return bool
+     */
+    static bool valid(const Response &response, const Record &record)
+    {
+        return Extractor::valid(record, TYPE_MX, 2) && Wire::check(response.data(), response.end(), record.data() + 2) != nullptr;
+    }
+
     /**
      *  Destructor
      */
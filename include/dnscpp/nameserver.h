@@ -0,0 +1,248 @@
+/**
+ *  Nameserver.h
+ *
+ *  Class with the address of a nameserver, plus the statistics that we keep
+ *  about its health: the smoothed round trip time and its variance (computed
+ *  like TCP does, see RFC 6298), and a failure score that goes up with every
+ *  timeout and that slowly decays over time. These statistics are used to
+ *  decide to which nameserver a datagram is sent, and can be inspected via
+ *  Context::nameservers() for monitoring purposes.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "ip.h"
+#include <cmath>
+#include <stddef.h>
+#include <vector>
+#include <algorithm>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Nameserver
+{
+private:
+    /**
+     *  The address of the nameserver
+     *  @var Ip
+     */
+    Ip _ip;
+
+    /**
+     *  Smoothed round trip time and its variance (in seconds, zero when there are no samples yet)
+     *  @var double
+     */
+    double _srtt = 0.0;
+    double _rttvar = 0.0;
+
+    /**
+     *  The failure score, and the time when it was last updated (the score is halved
+     *  every `halflife` seconds, so that a dead server is tried again after a while)
+     *  @var double
+     */
+    double _score = 0.0;
+    double _updated = 0.0;
+
+    /**
+     *  Number of rtt samples, responses, timeouts and truncated responses
+     *  @var size_t
+     */
+    size_t _samples = 0;
+    size_t _responses = 0;
+    size_t _timeouts = 0;
+    size_t _truncations = 0;
+
+    /**
+     *  The most recent rtt samples (a ring buffer, used to compute percentiles)
+     *  @var std::vector<double>
+     */
+    std::vector<double> _history;
+
+    /**
+     *  The last computed percentile, for which fraction, and at which number of samples
+     *  @var double
+     */
+    mutable double _percentile = -1.0;
+    mutable double _fraction = -1.0;
+    mutable size_t _computed = 0;
+
+    /**
+     *  Number of samples to keep in the history, and the number of new samples after
+     *  which the percentile is computed again
+     *  @var size_t
+     */
+    static const size_t history = 128;
+    static const size_t recompute = 16;
+
+    /**
+     *  Number of seconds in which the failure score is halved
+     *  @var double
+     */
+    static constexpr double halflife = 10.0;
+
+    /**
+     *  Max failure score (so that a server that was down for a long time is tried again within minutes)
+     *  @var double
+     */
+    static constexpr double maxscore = 8.0;
+
+public:
+    /**
+     *  Constructor
+     *  @param  ip          address of the nameserver
+     */
+    Nameserver(const Ip &ip) : _ip(ip) {}
+
+    /**
+     *  Destructor
+     */
+    virtual ~Nameserver() = default;
+
+    /**
+     *  The address of the nameserver
+     *  @return Ip
+     */
+    const Ip &ip() const { return _ip; }
+
+    /**
+     *  Cast to the address
+     *  @return Ip
+     */
+    operator const Ip & () const { return _ip; }
+
+    /**
+     *  The smoothed round trip time and its variance (zero when not yet known)
+     *  @return double
+     */
+    double srtt() const { return _srtt; }
+    double rttvar() const { return _rttvar; }
+
+    /**
+     *  The retransmission timeout: the time after which we no longer expect a response
+     *  (or zero when it is not yet known)
+     *  @return double
+     */
+    double rto() const { return _srtt + 4.0 * _rttvar; }
+
+    /**
+     *  A percentile of the recent round trip times (for example the 95th percentile when fraction
+     *  is 0.95). Returns a negative value if there are not enough samples to tell.
+     *  @param  fraction    the percentile to compute (between zero and one)
+     *  @return double
+     */
+    double percentile(double fraction) const
+    {
+        // we need a couple of samples to say something meaningful
+        if (_history.size() < recompute) return -1.0;
+        
+        // the previous result can be used if there were not too many new samples since then
+        if (fraction == _fraction && _samples < _computed + recompute) return _percentile;
+        
+        // copy the samples (they are going to be reordered)
+        std::vector<double> samples(_history);
+        
+        // find the sample at the right position
+        auto position = samples.begin() + std::min(size_t(fraction * samples.size()), samples.size() - 1);
+        std::nth_element(samples.begin(), position, samples.end());
+        
+        // remember the result
+        _fraction = fraction; _computed = _samples;
+        
+        // expose the result
+        return _percentile = *position;
+    }
+
+    /**
+     *  Number of rtt samples, received responses, timeouts and truncated responses
+     *  @return size_t
+     */
+    size_t samples() const { return _samples; }
+    size_t responses() const { return _responses; }
+    size_t timeouts() const { return _timeouts; }
+    size_t truncations() const { return _truncations; }
+
+    /**
+     *  The failure score at a certain time: the number of recent timeouts (older timeouts count for less)
+     *  @param  now         current time
+     *  @return double
+     */
+    double score(double now) const { return _score == 0.0 ? 0.0 : _score * std::exp2((_updated - now) / halflife); }
+
+    /**
+     *  The expected cost of sending a datagram to this server: the expected round trip time, plus
+     *  a penalty for the recent timeouts. Servers without samples are expected to be fast, so that
+     *  they are probed soon.
+     *  @param  now         current time
+     *  @param  penalty     the cost of a timeout (normally the interval before a datagram is sent again)
+     *  @return double
+     */
+    double cost(double now, double penalty) const { return rto() + score(now) * penalty; }
+
+    /**
+     *  Register that a response was received
+     *  @param  now         current time
+     *  @param  rtt         the measured round trip time (or < 0 if it is unknown, because the datagram was sent more than once)
+     */
+    void success(double now, double rtt)
+    {
+        // update counter
+        _responses += 1;
+
+        // a working server does not have to be avoided that much any more
+        _score = score(now) / 2.0; _updated = now;
+
+        // if the response can not be matched with a single datagram, we do not use it as sample (Karn's algorithm)
+        if (rtt < 0.0) return;
+
+        // remember the sample in the history
+        if (_history.size() < history) _history.push_back(rtt); else _history[_samples % history] = rtt;
+
+        // the first sample initializes the values (RFC 6298, section 2.2)
+        if (_samples++ == 0) { _srtt = rtt; _rttvar = rtt / 2.0; return; }
+
+        // next samples are smoothed (RFC 6298, section 2.3)
+        _rttvar = 0.75 * _rttvar + 0.25 * std::fabs(_srtt - rtt);
+        _srtt = 0.875 * _srtt + 0.125 * rtt;
+    }
+
+    /**
+     *  Register that the server sent a truncated response (that did not fit in a datagram)
+     */
+    void truncated() { _truncations += 1; }
+
+    /**
+     *  Register that the server did not respond in time
+     *  @param  now         current time
+     */
+    void failure(double now)
+    {
+        // update counter
+        _timeouts += 1;
+
+        // increment the score
+        _score = score(now) + 1.0; _updated = now;
+        
+        // but not too much
+        if (_score > maxscore) _score = maxscore;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -69,6 +69,15 @@ protected:
     Operation(Core *core, Handler *handler, int op, const char *dname, int type, const Bits &bits, const unsigned char *data = nullptr) :
         _core(core), _handler(handler), _query(op, dname, type, bits, data) {}
 
+    /**
+     *  Constructor for a query that was already constructed
+     *  @param  core        the core object
+     *  @param  handler     user space handler
+     *  @param  query       the query to send
+     */
+    Operation(Core *core, Handler *handler, const Query &query) :
+        _core(core), _handler(handler), _query(query) {}
+
     /**
      *  Private destructor because userspace is not supposed to destruct this
      */
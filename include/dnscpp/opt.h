@@ -38,6 +38,13 @@ public:
      */
     OPT(const Message &message, const Record &record) : Extractor(record, TYPE_OPT, 0) {}
     
+    /**
+     *  Check if the constructor can be called without an exception
+     *  @param  record
+     *  @return bool
+     */
+    static bool valid(const Record &record) { return Extractor::valid(record, TYPE_OPT, 0); }
+
     /**
      *  Destructor
      */
@@ -76,6 +83,38 @@ public:
         // which is on position three
         return (htonl(ttl()) & 0xff00) >> 8;
     }
+
+    /**
+     *  Find an option (a key-value pair in the data of the record)
+     *  @param  code        the option code to look for
+     *  @param  data        pointer to the value of the option (output parameter)
+     *  @param  size        size of the value (output parameter)
+     *  @return bool        false if the option was not found
+     */
+    bool option(uint16_t code, const unsigned char *&data, uint16_t &size) const
+    {
+        // the options follow each other, every option starts with a code and a size
+        for (const unsigned char *current = _record.data(), *end = current + _record.size(); end - current >= 4; current += 4 + size)
+        {
+            // get the code and size of this option
+            size = ns_get16(current + 2);
+
+            // the value must fit in the record
+            if (end - current - 4 < size) return false;
+
+            // skip if this is not the one we're looking for
+            if (ns_get16(current) != code) continue;
+
+            // expose the value
+            data = current + 4;
+
+            // found it
+            return true;
+        }
+
+        // not found
+        return false;
+    }
 };
     
 /**
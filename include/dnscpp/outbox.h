@@ -0,0 +1,263 @@
+/**
+ *  Outbox.h
+ *
+ *  Internal class with the queries that are waiting to be sent over a
+ *  UDP socket. Queries are not sent right away, but they are collected
+ *  and flushed together with a single sendmmsg() system call.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <limits.h>
+#include <errno.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "query.h"
+#include "ip.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Outbox
+{
+private:
+    /**
+     *  The queries that are waiting to be sent
+     *  @var std::vector
+     */
+    std::vector<Query> _queries;
+
+    /**
+     *  Target address of each query (we use an ipv6 struct because that is also big enough for ipv4)
+     *  @var std::vector
+     */
+    std::vector<struct sockaddr_in6> _addresses;
+
+    /**
+     *  The message headers and io-vectors that are passed to sendmmsg()
+     *  @var std::vector
+     */
+    std::vector<struct mmsghdr> _headers;
+    std::vector<struct iovec> _iovecs;
+
+    /**
+     *  Number of queries that have already been sent
+     *  @var size_t
+     */
+    size_t _sent = 0;
+
+    /**
+     *  Did the kernel report that the peer refused an earlier datagram? (only for connected sockets)
+     *  @var bool
+     */
+    bool _refused = false;
+
+    /**
+     *  Fill the headers for all queries that have not yet been sent
+     *  @param  connected   is the socket connected (then no address is passed)
+     */
+    void prepare(bool connected)
+    {
+        // we need a header for each query
+        _headers.resize(_queries.size());
+        _iovecs.resize(_queries.size());
+
+        // fill the headers that have not yet been sent
+        for (size_t i = _sent; i < _queries.size(); ++i)
+        {
+            // the io-vector points to the query
+            _iovecs[i].iov_base = (void *)_queries[i].data();
+            _iovecs[i].iov_len = _queries[i].size();
+
+            // the header refers to the io-vector and the address
+            memset(&_headers[i], 0, sizeof(struct mmsghdr));
+            _headers[i].msg_hdr.msg_iov = &_iovecs[i];
+            _headers[i].msg_hdr.msg_iovlen = 1;
+
+            // a connected socket already knows where the datagrams go
+            if (connected) continue;
+
+            // pass the target address
+            _headers[i].msg_hdr.msg_name = &_addresses[i];
+            _headers[i].msg_hdr.msg_namelen = _addresses[i].sin6_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+        }
+    }
+
+public:
+    /**
+     *  Constructor
+     */
+    Outbox() = default;
+
+    /**
+     *  No copying (the headers hold pointers into our own buffers)
+     *  @param  that
+     */
+    Outbox(const Outbox &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Outbox() = default;
+
+    /**
+     *  Add a query to the outbox
+     *  @param  ip          IP address of the nameserver (the port is always assumed to be 53)
+     *  @param  query       the query to send
+     *  @param  id          the ID with which the query is sent
+     *  @param  dualstack   is the query sent over a dual-stack socket (ipv4 addresses are then mapped)
+     */
+    void add(const Ip &ip, const Query &query, uint16_t id, bool dualstack = false)
+    {
+        // add the query, with the ID that was picked for it
+        _queries.push_back(query);
+        _queries.back().id(id);
+
+        // and construct the target address
+        _addresses.emplace_back();
+        memset(&_addresses.back(), 0, sizeof(struct sockaddr_in6));
+
+        // should we send in the ipv4 or ipv6 fashion?
+        if (ip.version() == 6)
+        {
+            // fill the members
+            _addresses.back().sin6_family = AF_INET6;
+            _addresses.back().sin6_port = htons(53);
+
+            // copy the address
+            memcpy(&_addresses.back().sin6_addr, (const struct in6_addr *)ip, sizeof(struct in6_addr));
+        }
+        else if (dualstack)
+        {
+            // fill the members
+            _addresses.back().sin6_family = AF_INET6;
+            _addresses.back().sin6_port = htons(53);
+
+            // the ipv4 address is mapped into an ipv6 address (::ffff:a.b.c.d)
+            _addresses.back().sin6_addr.s6_addr[10] = 0xff;
+            _addresses.back().sin6_addr.s6_addr[11] = 0xff;
+            memcpy(_addresses.back().sin6_addr.s6_addr + 12, (const struct in_addr *)ip, sizeof(struct in_addr));
+        }
+        else
+        {
+            // the ipv6 struct is big enough to hold an ipv4 address
+            struct sockaddr_in *info = (struct sockaddr_in *)&_addresses.back();
+
+            // fill the members
+            info->sin_family = AF_INET;
+            info->sin_port = htons(53);
+
+            // copy address
+            memcpy(&info->sin_addr, (const struct in_addr *)ip, sizeof(struct in_addr));
+        }
+    }
+
+    /**
+     *  Is the outbox empty?
+     *  @return bool
+     */
+    bool empty() const { return _sent == _queries.size(); }
+
+    /**
+     *  Number of queries that are still waiting to be sent
+     *  @return size_t
+     */
+    size_t size() const { return _queries.size() - _sent; }
+
+    /**
+     *  Forget all queries
+     */
+    void clear()
+    {
+        // the vectors keep their capacity, so that no memory is allocated for the next queries
+        _queries.clear();
+        _addresses.clear();
+        _sent = 0;
+    }
+
+    /**
+     *  Did the kernel report (while sending) that the peer refused an earlier datagram? 
+     *  This resets the flag, so that it is only reported once.
+     *  @return bool
+     */
+    bool refused()
+    {
+        // remember the old value
+        bool result = _refused;
+
+        // reset it
+        _refused = false;
+
+        // done
+        return result;
+    }
+
+    /**
+     *  Send as many queries as possible (without blocking)
+     *  @param  fd          the non-blocking socket to send over
+     *  @param  connected   is the socket connected to the nameserver?
+     *  @return bool        true if all queries were sent, false if the socket would block
+     */
+    bool send(int fd, bool connected = false)
+    {
+        // fill the headers
+        prepare(connected);
+
+        // keep sending until the outbox is empty
+        while (_sent < _queries.size())
+        {
+            // the kernel has a limit on the number of messages per call
+            size_t count = std::min(_queries.size() - _sent, size_t(IOV_MAX));
+
+            // send the messages
+            auto result = sendmmsg(fd, _headers.data() + _sent, count, MSG_NOSIGNAL);
+
+            // on success we can proceed with the next ones
+            if (result > 0) { _sent += result; continue; }
+
+            // if the socket buffer is full we have to wait until it is writable
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return false;
+
+            // the call was interrupted, we can simply retry
+            if (errno == EINTR) continue;
+
+            // on a connected socket, an icmp error for an earlier datagram is reported here
+            if (errno == ECONNREFUSED) _refused = true;
+
+            // the first message could not be sent at all (for example because the nameserver
+            // is unreachable), we skip it and treat it just as if it WAS sent, so that the
+            // problem will be picked up when the lookup times out
+            _sent += 1;
+        }
+
+        // everything was sent
+        clear();
+
+        // report success
+        return true;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -40,6 +40,14 @@ public:
      */
     virtual bool onLost(const Ip &ip) = 0;
     
+    /**
+     *  Method that is called when a nameserver turned out to be unreachable
+     *  This is used in case of connected UDP sockets, when the nameserver port is closed
+     *  @param  ip          the ip of the nameserver
+     *  @return bool
+     */
+    virtual bool onUnreachable(const Ip &ip) = 0;
+    
 };
 
 /**
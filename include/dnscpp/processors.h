@@ -0,0 +1,341 @@
+/**
+ *  Processors.h
+ *
+ *  Internal class that keeps track of the processors that are interested
+ *  in the responses that come in on a socket. This is a flat hash table
+ *  with open addressing (linear probing) that is indexed by the query ID,
+ *  so that subscribing, unsubscribing and looking up the processor for an
+ *  incoming response are all O(1) operations that do not allocate memory
+ *  (apart from the occasional growth of the table).
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include "ip.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Processor;
+
+/**
+ *  Class definition
+ */
+class Processors
+{
+private:
+    /**
+     *  Structure of a single slot in the table
+     */
+    struct Entry
+    {
+        /**
+         *  The processor, a nullptr means that the slot is empty
+         *  @var Processor
+         */
+        Processor *processor = nullptr;
+
+        /**
+         *  The query ID
+         *  @var uint16_t
+         */
+        uint16_t id = 0;
+
+        /**
+         *  The ID of the original query (the socket may send it with an other ID), the
+         *  response is passed to the processor with this ID
+         *  @var uint16_t
+         */
+        uint16_t original = 0;
+
+        /**
+         *  IP address from which the response is expected
+         *  @var Ip
+         */
+        Ip ip;
+    };
+
+    /**
+     *  All the slots (the number of slots is always a power of two)
+     *  @var std::vector
+     */
+    std::vector<Entry> _entries;
+
+    /**
+     *  Number of slots that are in use
+     *  @var size_t
+     */
+    size_t _size = 0;
+
+    /**
+     *  Slot at which pop() continues to look for an entry (so that emptying the table is a linear operation)
+     *  @var size_t
+     */
+    size_t _cursor = 0;
+
+    /**
+     *  The home slot of an entry
+     *  @param  id          the query ID
+     *  @param  ip          the IP address
+     *  @return size_t
+     */
+    size_t home(uint16_t id, const Ip &ip) const
+    {
+        // the mask to apply
+        size_t mask = _entries.size() - 1;
+
+        // query IDs are random, so they are already well distributed, only when
+        // the table is bigger than the ID-space we also mix in the address
+        if (mask <= 0xffff) return id & mask;
+
+        // fold the address
+        size_t hash = 0;
+        for (size_t i = 0; i < ip.size(); ++i) hash = hash * 31 + (uint8_t)ip.data()[i];
+
+        // combine with the ID
+        return (id | (hash << 16)) & mask;
+    }
+
+    /**
+     *  Change the number of slots (and re-insert all entries)
+     *  @param  slots       new number of slots, must be a power of two
+     */
+    void rehash(size_t slots)
+    {
+        // swap the old table out
+        std::vector<Entry> old(slots);
+        _entries.swap(old);
+
+        // the entries are in other slots now
+        _cursor = 0;
+
+        // re-insert everything
+        for (const auto &entry : old)
+        {
+            // skip empty slots
+            if (entry.processor == nullptr) continue;
+
+            // look for an empty slot
+            size_t mask = _entries.size() - 1, index = home(entry.id, entry.ip);
+            while (_entries[index].processor != nullptr) index = (index + 1) & mask;
+
+            // store it
+            _entries[index] = entry;
+        }
+    }
+
+    /**
+     *  Remove the entry at a certain slot
+     *  @param  index       the slot number
+     */
+    void erase(size_t index)
+    {
+        // the mask to apply
+        size_t mask = _entries.size() - 1;
+
+        // the slot is now empty
+        _entries[index].processor = nullptr;
+        _size -= 1;
+
+        // the entries that follow must be shifted back to keep the chains intact (this
+        // saves us from having to use tombstones, which would make lookups slower)
+        for (size_t next = (index + 1) & mask; _entries[next].processor != nullptr; next = (next + 1) & mask)
+        {
+            // the preferred slot of the next entry
+            size_t slot = home(_entries[next].id, _entries[next].ip);
+
+            // if the preferred slot is cyclically in between the hole and the entry itself, it stays where it is
+            if (((next - slot) & mask) < ((next - index) & mask)) continue;
+
+            // move it into the hole
+            _entries[index] = _entries[next];
+            _entries[next].processor = nullptr;
+
+            // the entry that we moved left a new hole
+            index = next;
+        }
+    }
+
+public:
+    /**
+     *  Constructor
+     */
+    Processors() = default;
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Processors(const Processors &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Processors() = default;
+
+    /**
+     *  Add a processor (nothing happens if exactly the same entry already exists)
+     *  @param  processor   the processor that wants to receive the response
+     *  @param  ip          the IP from which the response is expected
+     *  @param  id          the query ID
+     *  @param  original    the ID of the original query
+     */
+    void add(Processor *processor, const Ip &ip, uint16_t id, uint16_t original)
+    {
+        // we keep the load factor below one half to keep the chains short
+        if ((_size + 1) * 2 > _entries.size()) rehash(std::max(_entries.size() * 2, size_t(16)));
+
+        // look for an empty slot
+        size_t mask = _entries.size() - 1, index = home(id, ip);
+        for (; _entries[index].processor != nullptr; index = (index + 1) & mask)
+        {
+            // check if this is the same subscription
+            const auto &entry = _entries[index];
+            if (entry.processor == processor && entry.id == id && entry.ip == ip) return;
+        }
+
+        // store it
+        _entries[index].processor = processor;
+        _entries[index].id = id;
+        _entries[index].original = original;
+        _entries[index].ip = ip;
+
+        // update size
+        _size += 1;
+    }
+
+    /**
+     *  Remove a processor
+     *  @param  processor   the processor that is no longer interested
+     *  @param  ip          the IP from which the response was expected
+     *  @param  id          the query ID
+     *  @return bool        was it found?
+     */
+    bool remove(Processor *processor, const Ip &ip, uint16_t id)
+    {
+        // empty tables are easy
+        if (_size == 0) return false;
+
+        // walk the chain
+        size_t mask = _entries.size() - 1;
+        for (size_t index = home(id, ip); _entries[index].processor != nullptr; index = (index + 1) & mask)
+        {
+            // check if this is the entry
+            const auto &entry = _entries[index];
+            if (entry.processor != processor || entry.id != id || entry.ip != ip) continue;
+
+            // remove it
+            erase(index);
+
+            // report success
+            return true;
+        }
+
+        // not found
+        return false;
+    }
+
+    /**
+     *  Find the processor that is interested in a certain response
+     *  @param  ip          the IP from which the response came
+     *  @param  id          the query ID
+     *  @return Processor   nullptr if nobody is interested
+     */
+    Processor *find(const Ip &ip, uint16_t id) const
+    {
+        // the original ID is not needed
+        uint16_t original;
+
+        // pass on
+        return find(ip, id, original);
+    }
+
+    /**
+     *  Find the processor that is interested in a certain response, and the ID of its original query
+     *  @param  ip          the IP from which the response came
+     *  @param  id          the query ID
+     *  @param  original    the ID of the original query (output parameter)
+     *  @return Processor   nullptr if nobody is interested
+     */
+    Processor *find(const Ip &ip, uint16_t id, uint16_t &original) const
+    {
+        // empty tables are easy
+        if (_size == 0) return nullptr;
+
+        // walk the chain
+        size_t mask = _entries.size() - 1;
+        for (size_t index = home(id, ip); _entries[index].processor != nullptr; index = (index + 1) & mask)
+        {
+            // check if this is the entry
+            const auto &entry = _entries[index];
+            if (entry.id != id || entry.ip != ip) continue;
+
+            // expose the original ID
+            original = entry.original;
+
+            // found it
+            return entry.processor;
+        }
+
+        // not found
+        return nullptr;
+    }
+
+    /**
+     *  Remove an arbitrary processor from the table and return it
+     *  @return Processor   nullptr if the table is empty
+     */
+    Processor *pop()
+    {
+        // empty tables are easy
+        if (_size == 0) return nullptr;
+
+        // we continue where the previous call stopped, the slots before that were empty (entries that were added
+        // in the meantime can also be in those slots, but then we find them after wrapping around)
+        size_t mask = _entries.size() - 1;
+        while (_entries[_cursor].processor == nullptr) _cursor = (_cursor + 1) & mask;
+
+        // remember the processor
+        auto *processor = _entries[_cursor].processor;
+
+        // remove it from the table (a next entry might be moved into this slot, so the cursor stays here)
+        erase(_cursor);
+
+        // done
+        return processor;
+    }
+
+    /**
+     *  Number of processors
+     *  @return size_t
+     */
+    size_t size() const { return _size; }
+
+    /**
+     *  Is the table empty?
+     *  @return bool
+     */
+    bool empty() const { return _size == 0; }
+};
+
+/**
+ *  End of namespace
+ */
+}
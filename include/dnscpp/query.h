@@ -108,11 +108,12 @@ private:
     }
 
     /**
-     *  Does this query contain a specific record as question?
-     *  @param  record
+     *  Does this query contain a specific question from a response?
+     *  @param  response    the response
+     *  @param  index       the question-number in the response
      *  @return bool
      */
-    bool contains(const Question &record) const;
+    bool contains(const Response &response, size_t index) const;
     
     /**
      *  Helper method to add the edns pseudo-section
@@ -167,6 +168,12 @@ public:
      */
     uint16_t id() const noexcept;
 
+    /**
+     *  Change the ID (this is done by the sockets, that pick an ID that is not yet in use)
+     *  @param  id          the new ID
+     */
+    void id(uint16_t id) noexcept;
+
     /**
      *  The opcode
      *  @return uint8_t
@@ -186,6 +193,14 @@ public:
      *  @return bool
      */
     bool matches(const Response &response) const;
+
+    /**
+     *  Is the response about the same questions as this query? This does not check
+     *  the ID, so it can be used when the query was sent with a different ID
+     *  @param  response
+     *  @return bool
+     */
+    bool answers(const Response &response) const;
 };
     
 /**
@@ -36,6 +36,11 @@ public:
      */
     Question(const Message &message, size_t index = 0) : 
         Record(message, ns_s_qd, index) {}
+    
+    /**
+     *  Constructor for an empty question, call parse() to fill it (this does not throw)
+     */
+    Question() = default;
         
     /**
      *  Destructor
@@ -33,7 +33,17 @@ protected:
      *  The structure of libresolv with info about the record
      *  @var ns_rr
      */
-    ns_rr _record;
+    mutable ns_rr _record;
+
+private:
+    /**
+     *  The begin and end of the message and the position of the name, as long as the name
+     *  has not yet been decompressed (names are only decompressed when they are needed)
+     *  @var const unsigned char *
+     */
+    mutable const unsigned char *_begin = nullptr;
+    const unsigned char *_end = nullptr;
+    const unsigned char *_name = nullptr;
 
 public:
     /**
@@ -59,13 +69,25 @@ public:
      *  @param  index           the record-number inside the section
      *  @throws std::runtime_error
      */
-    Record(const Message &message, ns_sect section, int index) : Record(message.handle(), section, index) {}
+    Record(const Message &message, ns_sect section, int index)
+    {
+        // parse the record
+        if (parse(message, section, index)) return;
+        
+        // report an error
+        throw std::runtime_error("failed to parse record");
+    }
+    
+    /**
+     *  Constructor for an empty record, call parse() to fill it (this does not throw)
+     */
+    Record() { memset(&_record, 0, sizeof(ns_rr)); }
     
     /**
      *  Copy constructor 
      *  @param  that            object to copy
      */
-    Record(const Record &that)
+    Record(const Record &that) : _begin(that._begin), _end(that._end), _name(that._name)
     {
         // copy the structure
         memcpy(&_record, &that._record, sizeof(ns_rr));
@@ -76,12 +98,59 @@ public:
      */
     virtual ~Record() = default;
     
+    /**
+     *  Extract a record from a message. This is the alternative for the constructor that
+     *  does not throw, and that can be used to reuse the same object for multiple records.
+     *  @param  message         the message from which the record should be extracted
+     *  @param  section         the section to extract the record from
+     *  @param  index           the record-number inside the section
+     *  @return bool            false if the record does not exist, or if its name is malformed
+     */
+    bool parse(const Message &message, ns_sect section, size_t index)
+    {
+        // pointers to the record in the message (this uses the index of the message, so that 
+        // we do not have to walk over all previous records like ns_parserr() does)
+        const unsigned char *name, *fields;
+        
+        // find the record
+        if (!message.locate(section, index, name, fields)) return false;
+        
+        // the name is only decompressed when it is needed, but we do check right away whether it 
+        // can be decompressed (pointers inside the message, no loops, not too long)
+        if (Wire::check(message.data(), message.end(), name) == nullptr) return false;
+
+        // remember where to find the name
+        _begin = message.data(); _end = message.end(); _name = name;
+        
+        // the type and class
+        _record.type = ns_get16(fields);
+        _record.rr_class = ns_get16(fields + 2);
+        
+        // questions do not have a ttl and data
+        if (section == ns_s_qd) { _record.ttl = 0; _record.rdlength = 0; _record.rdata = nullptr; return true; }
+        
+        // the ttl and data
+        _record.ttl = ns_get32(fields + 4);
+        _record.rdlength = ns_get16(fields + 8);
+        _record.rdata = fields + NS_RRFIXEDSZ;
+        
+        // done
+        return true;
+    }
+    
     /**
      *  The name of the record
      *  @return const char *
      */
     const char *name() const
     {
+        // decompress the name if this was not yet done (this does not fail, parse() already checked the name)
+        if (_begin != nullptr && Wire::expand(_begin, _end, _name, _record.name, NS_MAXDNAME) < 0) _record.name[0] = '\0';
+        
+        // the name is now decompressed
+        _begin = nullptr;
+        
+        // expose the name
         return ns_rr_name(_record);
     }
     
@@ -29,6 +29,11 @@ namespace DNS {
 class Response : public Message 
 {
 public:
+    /**
+     *  Constructor for an empty response, call parse() to fill it (this does not throw)
+     */
+    Response() = default;
+
     /**
      *  Constructor
      *  @param  buffer      the raw data that we received
@@ -52,6 +52,17 @@ public:
      */
     RRSIG(const Response &response, const Record &record);
     
+    /**
+     *  Check if the constructor can be called without an exception (the name must be valid too)
+     *  @param  response
+     *  @param  record
+     *  @return bool
+     */
+    static bool valid(const Response &response, const Record &record)
+    {
+        return Extractor::valid(record, TYPE_RRSIG, 18) && Wire::check(response.data(), response.end(), record.data() + 18) != nullptr;
+    }
+
     /**
      *  Destructor
      */
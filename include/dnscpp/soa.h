@@ -54,6 +54,24 @@ public:
         _nameserver(response, record.data()),
         _email     (response, record.data() + _nameserver.consumed()) {}
     
+    /**
+     *  Check if the constructor can be called without an exception (both names must be valid too)
+     *  @param  response
+     *  @param  record
+     *  @return bool
+     */
+    static bool valid(const Response &response, const Record &record)
+    {
+        // check the type and size
+        if (!Extractor::valid(record, TYPE_SOA, 20)) return false;
+        
+        // the nameserver is followed by the email address
+        auto *email = Wire::check(response.data(), response.end(), record.data());
+        
+        // both names must be valid
+        return email != nullptr && Wire::check(response.data(), response.end(), email) != nullptr;
+    }
+    
     /**
      *  Destructor
      */
@@ -15,8 +15,9 @@
 /**
  *  Dependencies
  */
-#include <list>
+#include <arpa/nameser.h>
 #include "ip.h"
+#include "inbox.h"
 #include "inbound.h"
 #include "watchable.h"
 
@@ -24,6 +25,11 @@
  *  Begin of namespace
  */
 namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Response;
     
 /**
  *  Class definition
@@ -55,15 +61,54 @@ protected:
 private:
     /**
      *  All the buffered responses that came in
-     *  @var std::list
+     *  @var Inbox
+     */
+    Inbox _inbox;
+
+    /**
+     *  Buffer that is exchanged with the inbox when a response is processed (so that
+     *  the buffers are recycled, and nothing is allocated in the receive path)
+     *  @var std::vector
+     */
+    std::vector<unsigned char> _spare;
+
+    /**
+     *  Number of datagrams that were dropped because nobody was waiting for them
+     *  @var size_t
+     */
+    size_t _dropped = 0;
+
+    /**
+     *  Cheap check to find out if a received datagram could be a response that we are waiting 
+     *  for. This is called before the datagram is copied and parsed, so that late duplicates
+     *  (of datagrams that were sent more than once) and injection attempts cost almost nothing.
+     *  @param  addr    the address from which the message was received
+     *  @param  data    the response data
+     *  @param  size    size of the data
+     *  @return bool
      */
-    std::list<std::pair<Ip,std::vector<unsigned char>>> _responses;
+    bool expected(const sockaddr *addr, const unsigned char *data, size_t size) const
+    {
+        // responses come from the dns port
+        switch (addr->sa_family) {
+        case AF_INET:   if (((const struct sockaddr_in *)addr)->sin_port != htons(53)) return false; break;
+        case AF_INET6:  if (((const struct sockaddr_in6 *)addr)->sin6_port != htons(53)) return false; break;
+        default:        return false;
+        }
+        
+        // the header must be complete, and the message must be a response
+        if (size < HFIXEDSZ || (data[2] & 0x80) == 0) return false;
+        
+        // somebody must be waiting for this ID from this address
+        return _processors.find(Ip(addr), ns_get16(data)) != nullptr;
+    }
 
     /**
-     *  A response payload was received with this ID
-     *  @param  id    The identifier
+     *  A response was received (and is about to be passed to the processor that waits for it)
+     *  @param  id          the ID with which the response was received
+     *  @param  response    the received response (that already has the ID of the original query)
      */
-    virtual void onReceivedId(uint16_t id) {};
+    virtual void onReceived(uint16_t id, const Response &response) {};
 
 protected:
     /**
@@ -80,10 +125,18 @@ protected:
     /**
      *  Add a message for delayed processing
      *  @param  addr    the address from which the message was received
+     *  @param  data    the response data
+     *  @param  size    size of the data
+     */
+    void add(const sockaddr *addr, const unsigned char *data, size_t size);
+
+    /**
+     *  Add a message for delayed processing (the buffer is taken over, and the caller 
+     *  gets an empty buffer back that can be used for the next message)
+     *  @param  addr    the address from which the message was received
      *  @param  buffer  the response buffer
      */
-    void add(const sockaddr *addr, std::vector<unsigned char> &&buffer);
-    void add(const Ip &addr, std::vector<unsigned char> &&buffer);
+    void add(const Ip &addr, std::vector<unsigned char> &buffer);
 
 public:
     /**
@@ -97,7 +150,13 @@ public:
      *  Return true if there are buffered raw responses or is otherwise active
      *  @return bool
      */
-    virtual bool active() const noexcept { return !_responses.empty(); }
+    virtual bool active() const noexcept { return !_inbox.empty(); }
+
+    /**
+     *  Number of datagrams that were dropped because they were not a response to one of our queries
+     *  @return size_t
+     */
+    size_t dropped() const { return _dropped; }
 };
     
 /**
@@ -0,0 +1,94 @@
+/**
+ *  SocketFilter.h
+ *
+ *  Internal class that attaches a classic BPF program to a UDP socket,
+ *  so that datagrams that can not be a response to one of our queries
+ *  (not from the dns port, shorter than a dns header, or without the
+ *  QR bit) are already dropped by the kernel, before they are copied
+ *  to user space. This is a second line of defense against floods of
+ *  unsolicited traffic, the Socket class does the same (and more)
+ *  checks in user space.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <arpa/nameser.h>
+#include <stdint.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class SocketFilter
+{
+public:
+    /**
+     *  Attach the filter to a UDP socket (ipv4 or ipv6). The program that runs in the
+     *  kernel sees the datagram starting with the UDP header (eight bytes, the source
+     *  port comes first), followed by the dns message.
+     *  @param  fd          the socket
+     *  @param  port        the port from which responses are accepted
+     *  @return bool
+     */
+    static bool attach(int fd, uint16_t port = NS_DEFAULTPORT)
+    {
+        // the program
+        struct sock_filter program[] = {
+            // the source port must be the dns port (otherwise jump to the last instruction)
+            BPF_STMT(BPF_LD  | BPF_H   | BPF_ABS, 0),
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   port, 0, 5),
+
+            // the datagram must hold at least a udp header and a dns header
+            BPF_STMT(BPF_LD  | BPF_W   | BPF_LEN, 0),
+            BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K,   8 + NS_HFIXEDSZ, 0, 3),
+
+            // the QR bit (the high bit of the third byte of the dns header) must be set
+            BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 8 + 2),
+            BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K,  0x80, 0, 1),
+
+            // accept the full datagram, or drop it
+            BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+            BPF_STMT(BPF_RET | BPF_K, 0),
+        };
+
+        // the structure that is passed to the kernel
+        struct sock_fprog filter = { sizeof(program) / sizeof(program[0]), program };
+
+        // install it
+        return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &filter, sizeof(filter)) == 0;
+    }
+
+    /**
+     *  Remove the filter from a socket
+     *  @param  fd          the socket
+     *  @return bool
+     */
+    static bool detach(int fd)
+    {
+        // the value is ignored by the kernel
+        int value = 0;
+
+        // remove the filter
+        return setsockopt(fd, SOL_SOCKET, SO_DETACH_FILTER, &value, sizeof(value)) == 0;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -23,6 +23,7 @@
 #include <sys/socket.h>
 #include <memory>
 #include "monitor.h"
+#include "timer.h"
 #include "watchable.h"
 #include "udp.h"
 #include "tcp.h"
@@ -48,7 +49,7 @@ class Connector;
 /**
  *  Class definition
  */
-class Sockets : private Watchable, private Tcp::Handler
+class Sockets : private Watchable, private Timer, private Tcp::Handler
 {
 public:
     /**
@@ -89,12 +90,40 @@ private:
      */
     std::list<Udp>::iterator _current;
 
+    /**
+     *  Should every nameserver get its own connected UDP socket?
+     *  @var bool
+     */
+    bool _connect = false;
+
+    /**
+     *  The connected UDP sockets (one per nameserver)
+     *  @var std::list<Udp>
+     */
+    std::list<Udp> _peers;
+
     /**
      *  Collection of TCP sockets
      *  @var std::vector
      */
     std::vector<std::shared_ptr<Tcp>> _tcps;
 
+    /**
+     *  Max number of unused TCP connections that are kept open, and for how long (in seconds)
+     *  @var size_t
+     *  @var double
+     */
+    size_t _maxidle = 0;
+    double _idletime = 0.0;
+
+    /**
+     *  Timer to close unused TCP connections, and the time when it expires
+     *  @var void*
+     *  @var double
+     */
+    void *_timer = nullptr;
+    double _expires = 0.0;
+
     /**
      *  This method is called when a socket has an inbound buffer that requires processing
      *  @param  socket  the reporting object
@@ -110,6 +139,36 @@ private:
      *  @param  socket
      */
     virtual void onUnused(Tcp *tcp) override;
+
+    /**
+     *  Are unused connections kept open?
+     *  @return bool
+     */
+    virtual bool pooled() const override { return _maxidle > 0 && _idletime > 0.0; }
+
+    /**
+     *  How long an unused TCP connection is kept open (the server may want a shorter period)
+     *  @param  tcp         the connection
+     *  @return double
+     */
+    double idletime(const Tcp *tcp) const;
+
+    /**
+     *  Set the timer to close the unused TCP connections
+     */
+    void timer();
+
+    /**
+     *  Method that is called when the timer expires
+     */
+    virtual void expire() override;
+    
+    /**
+     *  Find (or create) the connected socket for a nameserver
+     *  @param  ip          IP address of the nameserver
+     *  @return Udp
+     */
+    Udp &peer(const Ip &ip);
     
     
 public:
@@ -130,7 +189,7 @@ public:
     /**
      *  Destructor
      */
-    virtual ~Sockets() = default;
+    virtual ~Sockets();
 
     /**
      *  Update the number of sockets
@@ -141,14 +200,22 @@ public:
      */
     void sockets(size_t count);
 
+    /**
+     *  The max number of operations that can run at the same time: every socket has its own
+     *  ID space (per nameserver), and we keep at most half of the IDs of each socket in use.
+     *  In connected mode there is just one socket per nameserver, so more sockets do not help
+     *  @return size_t
+     */
+    size_t capacity() const;
+
     /**
      *  Send a query to the socket
-     *  Watch out: you need to be consistent in calling this with either ipv4 or ipv6 addresses
      *  @param  ip          IP address of the target nameserver
      *  @param  query       the query to send
+     *  @param  id          the ID with which the query is sent (output parameter)
      *  @return Inbound     the inbound object over which the message is sent
      */
-    Inbound *datagram(const Ip &ip, const Query &query);
+    Inbound *datagram(const Ip &ip, const Query &query, uint16_t &id);
 
     /**
      *  Connect with TCP to a socket
@@ -159,6 +226,32 @@ public:
      */
     Connecting *connect(const Ip &ip, Connector *connector);
 
+    /**
+     *  Find an established TCP connection to a nameserver (that can be used right away)
+     *  @param  ip          IP address of the nameserver
+     *  @return Tcp         the connection, or nullptr if there is none
+     */
+    Tcp *established(const Ip &ip);
+
+    /**
+     *  Keep unused TCP connections open, so that they can be used again later. If the server 
+     *  announces a shorter idle timeout (with the edns-tcp-keepalive option), that is respected.
+     *  @param  connections max number of unused connections to keep open (zero to close them right away)
+     *  @param  seconds     how long unused connections are kept open
+     */
+    void pool(size_t connections, double seconds) { _maxidle = connections; _idletime = seconds; }
+
+    /**
+     *  Send out all queries that are waiting in the outboxes of the sockets
+     */
+    void flush()
+    {
+        // pass on
+        for (auto &socket: _udps) socket.flush();
+        for (auto &socket: _peers) socket.flush();
+        for (auto &socket: _tcps) socket->flush();
+    }
+
     /**
      *  Deliver messages that have already been received and buffered to their appropriate processor
      *  @param  size_t      max number of calls to userspace
@@ -180,6 +273,76 @@ public:
     {
         // pass on
         for (auto &socket: _udps) socket.buffersize(size);
+        for (auto &socket: _peers) socket.buffersize(size);
+    }
+
+    /**
+     *  The max number of datagrams that each socket receives with one system call
+     *  @param  count       number of datagrams
+     */
+    void batchsize(size_t count)
+    {
+        // pass on
+        for (auto &socket: _udps) socket.batchsize(count);
+        for (auto &socket: _peers) socket.batchsize(count);
+    }
+
+    /**
+     *  Set the lifetime policy of the UDP sockets: after how many queries or seconds they get a
+     *  new port (if both are zero, sockets are closed when idle and get a new port when reused)
+     *  @param  queries     max number of queries per port (zero for no limit)
+     *  @param  seconds     max number of seconds per port (zero for no limit)
+     *  @param  idle        number of seconds after which an idle socket is closed anyway
+     */
+    void lifetime(size_t queries, double seconds, double idle)
+    {
+        // pass on
+        for (auto &socket: _udps) socket.lifetime(queries, seconds, idle);
+        for (auto &socket: _peers) socket.lifetime(queries, seconds, idle);
+    }
+
+    /**
+     *  Should the kernel drop datagrams that can not be a response?
+     *  @param  value       the new setting
+     */
+    void filter(bool value)
+    {
+        // pass on
+        for (auto &socket: _udps) socket.filter(value);
+        for (auto &socket: _peers) socket.filter(value);
+    }
+
+    /**
+     *  Should every nameserver get its own connected UDP socket? Datagrams are then
+     *  sent with send() instead of sendto(), the kernel only passes on datagrams from
+     *  the nameserver, and when the nameserver port is closed the lookups hear it right 
+     *  away instead of waiting for a timeout. Sockets that are already in use are not
+     *  affected by this setting.
+     *  @param  value       the new setting
+     */
+    void connected(bool value) { _connect = value; }
+
+    /**
+     *  Is every nameserver getting its own connected UDP socket?
+     *  @return bool
+     */
+    bool connected() const { return _connect; }
+
+    /**
+     *  Number of datagrams that were dropped because they were not a response to one of our queries
+     *  @return size_t
+     */
+    size_t dropped() const
+    {
+        // the result
+        size_t result = 0;
+        
+        // add up the numbers of all sockets
+        for (const auto &socket : _udps) result += socket.dropped();
+        for (const auto &socket : _peers) result += socket.dropped();
+        
+        // done
+        return result;
     }
 
     /**
@@ -190,6 +353,8 @@ public:
     {
         // if there's a buffered response in one of the sockets then we consider ourselves buffered
         for (const auto &sock : _udps) if (sock.active()) return true;
+        for (const auto &sock : _peers) if (sock.active()) return true;
+        for (const auto &sock : _tcps) if (sock->active()) return true;
 
         // otherwise we're not buffered
         return false;
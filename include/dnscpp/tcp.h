@@ -19,8 +19,7 @@
 #include <netinet/tcp.h>
 #include <unistd.h>
 #include <deque>
-#include <map>
-#include <set>
+#include <bitset>
 #include "socket.h"
 #include "monitor.h"
 #include "connecting.h"
@@ -54,6 +53,12 @@ public:
          *  @param  socket
          */
         virtual void onUnused(Tcp *tcp) = 0;
+
+        /**
+         *  Are unused connections kept open (so that we should ask the server to keep them open too)?
+         *  @return bool
+         */
+        virtual bool pooled() const = 0;
     };
 
 private:
@@ -93,6 +98,32 @@ private:
      */
     size_t _transferred = 0;
 
+    /**
+     *  Framed queries (every query is preceded by its two-byte size) that still have to be
+     *  written to the socket, they are flushed all at once when the socket is writable
+     *  @var std::vector
+     */
+    std::vector<unsigned char> _output;
+
+    /**
+     *  The events for which the socket is monitored (1 = readability, 2 = writability)
+     *  @var int
+     */
+    int _events = 2;
+
+    /**
+     *  The idle timeout that the server announced with the edns-tcp-keepalive option 
+     *  (in seconds, or a negative value if the server did not announce one)
+     *  @var double
+     */
+    double _keepalive = -1.0;
+
+    /**
+     *  Since when is the connection unused, and kept open in case it is needed again? (zero when in use)
+     *  @var double
+     */
+    double _idle = 0.0;
+
     /**
      *  Identifier user for monitoring the filedescriptor in the event loop
      *  @var void *
@@ -111,16 +142,18 @@ private:
     } _state = State::connecting;
 
     /**
-     *  Query IDs currently sent over the wire
-     *  @var std::set
+     *  The connection has its own ID space: queries are sent with an ID that is not yet in use on
+     *  the connection, this bitmap holds the IDs that were sent and for which no response came in yet
+     *  (also when the lookup already gave up, so the bitmap is only cleared when the connection closes)
+     *  @var std::bitset
      */
-    std::set<uint16_t> _queryids;
+    std::bitset<65536> _inflight;
 
     /**
-     *  Queries awaiting to be sent over the wire, but had an ID collision with one that is already in flight
-     *  @var std::multimap
+     *  Number of IDs in the bitmap
+     *  @var size_t
      */
-    std::multimap<uint16_t, Query> _awaiting;
+    size_t _pending = 0;
 
     /**
      *  Connectors that want to use this TCP socket for sending out a query
@@ -168,10 +201,11 @@ private:
     virtual void notify() override;
 
     /**
-     *  A response payload was received with this ID
-     *  @param  id    The identifier
+     *  A response was received
+     *  @param  id          the ID with which the response was received
+     *  @param  response    the received response
      */
-    virtual void onReceivedId(uint16_t id) override;
+    virtual void onReceived(uint16_t id, const Response &response) override;
 
     /**
      *  Number of bytes that we expect in the next read operation
@@ -200,11 +234,24 @@ private:
     virtual void unsubscribe(Connector *connector) override;
 
     /**
-     *  Blocking send this query
-     *  @param  query  The query
-     *  @return this or nullptr if something went wrong
+     *  Pick a random query ID that is not yet in use on this connection
+     *  @param  id          the ID (output parameter)
+     *  @return bool        false if all IDs are in use
+     */
+    bool allocate(uint16_t &id) const;
+
+    /**
+     *  Add a query to the output buffer
+     *  @param  query       the query
+     *  @param  id          the ID with which the query is sent
+     */
+    void append(const Query &query, uint16_t id);
+
+    /**
+     *  Change the events for which the socket is monitored
+     *  @param  events      1 = readability, 3 = readability and writability
      */
-    Inbound *sendimpl(const Query &query);
+    void monitor(int events);
 
 public:
     /**
@@ -234,13 +281,53 @@ public:
      */
     const Ip &ip() const { return _ip; }
 
+    /**
+     *  Is the connection established (and can queries be sent over it right away)?
+     *  @return bool
+     */
+    bool established() const { return _state == State::connected; }
+
+    /**
+     *  The idle timeout that the server announced (in seconds, or negative if it did not announce one)
+     *  @return double
+     */
+    double keepalive() const { return _keepalive; }
+
+    /**
+     *  Since when is the connection unused? (zero if it is in use)
+     *  @return double
+     */
+    double idle() const { return _idle; }
+
+    /**
+     *  Mark the connection as unused since a certain time (zero to mark it as in use)
+     *  @param  since       the time since when the connection is unused
+     */
+    void idle(double since) { _idle = since; }
+
+    /**
+     *  Is the ID space of the connection (almost) exhausted? New lookups should then use an other connection
+     *  @return bool
+     */
+    bool full() const;
+
     /**
      *  Send a full query
+     *  The query is not immediately written, but added to the output buffer that is flushed
+     *  later (together with the other queries that are sent over this connection). The query is
+     *  sent with an ID that is picked by the connection, and the response gets the ID of the
+     *  query back before it is passed on (when the subscriber passes that original ID).
      *  Note that this method can return nullptr in case the connection was already lost in the meantime
      *  @param  query       the query to send
+     *  @param  id          the ID with which the query is sent (output parameter)
      *  @return Inbound     the object that can be subscribed to for further processing
      */
-    Inbound *send(const Query &query);
+    Inbound *send(const Query &query, uint16_t &id);
+
+    /**
+     *  Write the output buffer to the socket (as far as this is possible without blocking)
+     */
+    void flush();
 
     /**
      *  Extended deliver() method (derives from the base class) that also takes the responsibility
@@ -249,6 +336,12 @@ public:
      *  @return size_t
      */
     virtual size_t process(size_t maxcalls) override;
+
+    /**
+     *  Return true if there are buffered raw responses, or queries that can be flushed
+     *  @return bool
+     */
+    virtual bool active() const noexcept override { return Socket::active() || (!_output.empty() && _events == 1); }
 };
     
 /**
@@ -53,6 +53,13 @@ public:
      */
     TLSA(const Record &record) : Extractor(record, TYPE_TLSA, 3) {}
 
+    /**
+     *  Check if the constructor can be called without an exception
+     *  @param  record
+     *  @return bool
+     */
+    static bool valid(const Record &record) { return Extractor::valid(record, TYPE_TLSA, 3); }
+
     /**
      *  Destructor
      */
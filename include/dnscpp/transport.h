@@ -0,0 +1,33 @@
+/**
+ *  Transport.h
+ * 
+ *  Enumeration of the policies to choose between udp and tcp for sending queries
+ * 
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  This is an enumeration type
+ */
+enum class Transport
+{
+    udp,            // datagrams first, tcp is only used when a response was truncated
+    tcp,            // queries are always sent over tcp
+    adaptive,       // tcp for nameservers that truncated a number of responses, datagrams for the others
+};
+    
+/**
+ *  End of namespace
+ */
+}
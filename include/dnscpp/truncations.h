@@ -0,0 +1,222 @@
+/**
+ *  Truncations.h
+ *
+ *  Memory of the questions for which a nameserver recently sent a truncated
+ *  response. A next lookup for the same question is sent to that nameserver
+ *  over tcp right away, which saves the round trip of the datagram that would
+ *  be truncated again. The memory holds a limited number of entries, and every
+ *  entry expires after a while (so that we find out when the response fits in
+ *  a datagram again).
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <string>
+#include <list>
+#include <unordered_map>
+#include "ip.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Truncations
+{
+private:
+    /**
+     *  Structure of a single entry
+     */
+    struct Entry
+    {
+        /**
+         *  The key: the address of the nameserver followed by the fingerprint of the question
+         *  @var std::string
+         */
+        std::string key;
+
+        /**
+         *  Time when the entry expires
+         *  @var double
+         */
+        double expires;
+    };
+
+    /**
+     *  All entries, the most recently added entry at the front (so the entries at the back expire first)
+     *  @var std::list
+     */
+    std::list<Entry> _entries;
+
+    /**
+     *  Index of the entries by their key
+     *  @var std::unordered_map
+     */
+    std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+
+    /**
+     *  Max number of entries (zero means that the memory is disabled)
+     *  @var size_t
+     */
+    size_t _capacity = 1024;
+
+    /**
+     *  Number of seconds that an entry is remembered
+     *  @var double
+     */
+    double _ttl = 300.0;
+
+    /**
+     *  Number of lookups that went to tcp right away (and thus saved a round trip)
+     *  @var size_t
+     */
+    size_t _saved = 0;
+
+    /**
+     *  Construct the key
+     *  @param  ip          address of the nameserver
+     *  @param  question    fingerprint of the question
+     *  @return std::string
+     */
+    static std::string key(const Ip &ip, const std::string &question)
+    {
+        // the address comes first
+        return std::string(ip.data(), ip.size()).append(question);
+    }
+
+    /**
+     *  Remove the entry at the back
+     */
+    void pop()
+    {
+        // remove from the index and the list
+        _index.erase(_entries.back().key);
+        _entries.pop_back();
+    }
+
+public:
+    /**
+     *  Constructor
+     */
+    Truncations() = default;
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Truncations(const Truncations &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Truncations() = default;
+
+    /**
+     *  Change the max number of entries and the number of seconds that they are remembered
+     *  @param  entries     max number of entries (zero to disable)
+     *  @param  seconds     number of seconds that an entry is remembered
+     */
+    void capacity(size_t entries, double seconds)
+    {
+        // update the settings
+        _capacity = entries; _ttl = seconds;
+
+        // remove the entries that no longer fit
+        while (_entries.size() > _capacity) pop();
+    }
+
+    /**
+     *  Number of entries
+     *  @return size_t
+     */
+    size_t entries() const { return _entries.size(); }
+
+    /**
+     *  Number of lookups that went to tcp right away (the number of round trips that were saved)
+     *  @return size_t
+     */
+    size_t saved() const { return _saved; }
+
+    /**
+     *  Remember that a nameserver sent a truncated response to a question
+     *  @param  ip          address of the nameserver
+     *  @param  question    fingerprint of the question
+     *  @param  now         current time
+     */
+    void add(const Ip &ip, const std::string &question, double now)
+    {
+        // do nothing if disabled, or for questions without a fingerprint
+        if (_capacity == 0 || _ttl <= 0.0 || question.empty()) return;
+
+        // the key under which it is stored
+        auto key = Truncations::key(ip, question);
+
+        // if the question is already known we forget the old entry
+        auto iter = _index.find(key);
+        if (iter != _index.end()) { _entries.erase(iter->second); _index.erase(iter); }
+
+        // make room for the new entry
+        while (_entries.size() >= _capacity) pop();
+
+        // add the entry at the front
+        _entries.push_front(Entry{ key, now + _ttl });
+        _index.emplace(std::move(key), _entries.begin());
+    }
+
+    /**
+     *  Should a question be sent to a nameserver over tcp right away? (entries that expired are removed)
+     *  @param  ip          address of the nameserver
+     *  @param  question    fingerprint of the question
+     *  @param  now         current time
+     *  @return bool
+     */
+    bool contains(const Ip &ip, const std::string &question, double now)
+    {
+        // the entries that expired are at the back
+        while (!_entries.empty() && _entries.back().expires <= now) pop();
+
+        // nothing to find if the memory is empty
+        if (_entries.empty() || question.empty()) return false;
+
+        // is the question known?
+        return _index.find(key(ip, question)) != _index.end();
+    }
+
+    /**
+     *  Forget that a nameserver sent a truncated response to a question (because tcp did not work)
+     *  @param  ip          address of the nameserver
+     *  @param  question    fingerprint of the question
+     */
+    void remove(const Ip &ip, const std::string &question)
+    {
+        // find the entry
+        auto iter = _index.find(key(ip, question));
+        if (iter == _index.end()) return;
+
+        // remove it from the list and the index
+        _entries.erase(iter->second);
+        _index.erase(iter);
+    }
+
+    /**
+     *  Count a lookup that was sent over tcp right away (because of an entry in the memory)
+     */
+    void save() { _saved += 1; }
+};
+
+/**
+ *  End of namespace
+ */
+}
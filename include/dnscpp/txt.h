@@ -94,6 +94,13 @@ public:
         }
     }
 
+    /**
+     *  Check if the constructor can be called without an exception
+     *  @param  record
+     *  @return bool
+     */
+    static bool valid(const Record &record) { return Extractor::valid(record, TYPE_TXT, 0); }
+
     /**
      *  Destructor
      */
@@ -3,6 +3,9 @@
 #include "monitor.h"
 #include "inbound.h"
 #include "socket.h"
+#include "datagrams.h"
+#include "outbox.h"
+#include "timer.h"
 #include <list>
 
 /**
@@ -17,7 +20,7 @@ class Watcher;
 /**
  *  Class declaration
  */
-class Udp : public Socket, private Monitor
+class Udp : public Socket, private Monitor, private Timer
 {
 private:
     /**
@@ -38,12 +41,102 @@ private:
      */
     int _fd = -1;
 
+    /**
+     *  The previous filedescriptor after the socket was rotated to a new port (it is kept
+     *  open for a while, because responses to queries that were sent over it can still come in)
+     *  @var int
+     */
+    int _draining = -1;
+
+    /**
+     *  User space identifier of the draining filedescriptor
+     *  @var void *
+     */
+    void *_drainid = nullptr;
+
+    /**
+     *  The lifetime policy: after how many queries, or after how many seconds, the socket 
+     *  gets a new port (zero means no limit, if both are zero the socket is closed when idle)
+     *  @var size_t
+     *  @var double
+     */
+    size_t _maxqueries = 0;
+    double _maxage = 0.0;
+
+    /**
+     *  Number of seconds that an idle socket is kept open (only when a lifetime policy is set)
+     *  @var double
+     */
+    double _maxidle = 10.0;
+
+    /**
+     *  Timer that closes the socket when it has been idle for long enough
+     *  @var void *
+     */
+    void *_timer = nullptr;
+
+    /**
+     *  Number of queries sent since the socket was opened, and the time when it was opened
+     *  @var size_t
+     *  @var double
+     */
+    size_t _queries = 0;
+    double _opened = 0.0;
+
     /**
      *  Buffersize for inbound sockets
      *  @var size_t
      */
     size_t _buffersize = 0;
 
+    /**
+     *  Should unsolicited datagrams already be dropped by the kernel?
+     *  @var bool
+     */
+    bool _filter = false;
+
+    /**
+     *  The nameserver to which the socket is connected (only for connected sockets)
+     *  @var Ip
+     */
+    Ip _peer;
+
+    /**
+     *  Is this a connected socket? Such a socket only sends to and receives from its peer
+     *  @var bool
+     */
+    bool _connected = false;
+
+    /**
+     *  Did the kernel report that the peer refused our datagrams (port unreachable)?
+     *  @var bool
+     */
+    bool _refused = false;
+
+    /**
+     *  Is this a dual-stack socket (so that ipv4 nameservers are reached via ipv4-mapped addresses)?
+     *  @var bool
+     */
+    bool _dualstack = false;
+
+    /**
+     *  Slots in which datagrams are received (multiple datagrams per system call)
+     *  @var Datagrams
+     */
+    Datagrams _datagrams;
+
+    /**
+     *  Queries that are waiting to be sent
+     *  @var Outbox
+     */
+    Outbox _outbox;
+
+    /**
+     *  The events for which the socket is monitored (1 = readability, 3 = also writability)
+     *  @var int
+     */
+    int _events = 0;
+
     /**
      *  Helper method to set an integer socket option
      *  @param  optname
@@ -70,20 +163,40 @@ private:
     virtual void reset() override;
 
     /**
-     *  Send a query to a certain nameserver
-     *  @param  address     target address
-     *  @param  size        size of the address
-     *  @param  query       query to send
+     *  Method that is called when the idle timer expires
+     */
+    virtual void expire() override;
+
+    /**
+     *  Stop the idle timer (if it is running)
+     */
+    void wakeup();
+
+    /**
+     *  Change the events for which the socket is monitored
+     *  @param  events      1 = readability, 3 = readability and writability
+     */
+    void monitor(int events);
+
+    /**
+     *  Open the socket (a dual-stack socket, or a plain ipv4 socket on hosts without ipv6)
      *  @return bool
      */
-    bool send(const struct sockaddr *address, size_t size, const Query &query);
+    bool open();
+
+    /**
+     *  Pick a random query ID that is not yet in use for a nameserver
+     *  @param  ip          the nameserver
+     *  @param  id          the ID (output parameter)
+     *  @return bool        false if all IDs are in use
+     */
+    bool allocate(const Ip &ip, uint16_t &id) const;
 
     /**
-     *  Open the socket
-     *  @param  version     IPv4 or IPv6. You must ensure this stays consistent over multiple requests (@todo)
+     *  Connect the socket to the peer
      *  @return bool
      */
-    bool open(int version);
+    bool connect();
 
     /**
      *  Close the socket
@@ -91,6 +204,33 @@ private:
      */
     void close();
 
+    /**
+     *  Close the filedescriptor that was draining after a rotation
+     */
+    void drained();
+
+    /**
+     *  Is the socket due for a new port (according to the lifetime policy)?
+     *  @return bool
+     */
+    bool due() const;
+
+    /**
+     *  Give the socket a new port, the old filedescriptor is kept open while responses can still come in
+     */
+    void rotate();
+
+    /**
+     *  Receive all datagrams that are waiting on a filedescriptor
+     *  @param  fd          the filedescriptor to read from
+     */
+    void receive(int fd);
+
+    /**
+     *  Remember that the peer is unreachable, its subscribers are notified when the socket is processed
+     */
+    void unreachable();
+
 public:
     /**
      *  Constructor does nothing but store a pointer to a handler object.
@@ -100,6 +240,15 @@ public:
      */
     Udp(Loop *loop, Socket::Handler *handler);
 
+    /**
+     *  Constructor for a socket that is connected to a single nameserver, and that
+     *  hears it from the kernel when the nameserver is unreachable
+     *  @param  loop        the event loop
+     *  @param  handler     parent object that is notified in case of relevant events
+     *  @param  peer        the nameserver to connect to
+     */
+    Udp(Loop *loop, Socket::Handler *handler, const Ip &peer);
+
     /**
      *  Closes the file descriptor
      */
@@ -107,11 +256,43 @@ public:
 
     /**
      *  Send a query over this socket
+     *  The query is not immediately sent, but added to the outbox, call flush() to really send it
      *  @param  ip IP address to send to. The port is always assumed to be 53.
      *  @param  query  The query
+     *  @param  id  The ID with which the query is sent (output parameter, subscribe with this ID)
      *  @return this, or nullptr if something went wrong
      */
-    Inbound *send(const Ip &ip, const Query &query);
+    Inbound *send(const Ip &ip, const Query &query, uint16_t &id);
+
+    /**
+     *  Send all queries in the outbox (as far as this is possible without blocking)
+     */
+    void flush();
+
+    /**
+     *  Invoke callback handlers for buffered raw responses (and tell the subscribers when the peer is unreachable)
+     *  @param   maxcalls  the max number of callback handlers to invoke
+     *  @return  number of callback handlers invoked
+     */
+    virtual size_t process(size_t maxcalls) override;
+
+    /**
+     *  Return true if there are buffered raw responses, or queries that can be flushed
+     *  @return bool
+     */
+    virtual bool active() const noexcept override { return Socket::active() || _refused || (!_outbox.empty() && _events != 3); }
+
+    /**
+     *  The nameserver to which this socket is connected
+     *  @return Ip
+     */
+    const Ip &peer() const { return _peer; }
+
+    /**
+     *  Is this socket connected to a single nameserver?
+     *  @return bool
+     */
+    bool connected() const { return _connected; }
 
     /**
      *  Install a new buffersize
@@ -124,6 +305,50 @@ public:
      *  @return size_t
      */
     size_t buffersize() const { return _buffersize; }
+
+    /**
+     *  Install the max number of datagrams that are received with one system call
+     *  @param  count       number of datagrams
+     */
+    void batchsize(size_t count) { _datagrams.resize(count); }
+
+    /**
+     *  Expose the max number of datagrams received with one system call
+     *  @return size_t
+     */
+    size_t batchsize() const { return _datagrams.capacity(); }
+
+    /**
+     *  Set the lifetime policy. When a limit is set, the socket stays open when it is idle, and it
+     *  gets a new port after a number of queries or seconds. Without limits (the default) the socket 
+     *  is closed as soon as it becomes idle, so that it gets a new port when it is used again.
+     *  @param  queries     max number of queries to send from one port (zero for no limit)
+     *  @param  seconds     max number of seconds to use one port (zero for no limit)
+     *  @param  idle        number of seconds after which an idle socket is closed anyway
+     */
+    void lifetime(size_t queries, double seconds, double idle) { _maxqueries = queries; _maxage = seconds; _maxidle = idle; }
+
+    /**
+     *  Expose the lifetime policy
+     *  @return size_t
+     *  @return double
+     */
+    size_t maxqueries() const { return _maxqueries; }
+    double maxage() const { return _maxage; }
+    double maxidle() const { return _maxidle; }
+
+    /**
+     *  Should a socket filter be attached, so that the kernel drops datagrams that can 
+     *  not be a response (this also changes the socket if it is already open)
+     *  @param  value       the new setting
+     */
+    void filter(bool value);
+
+    /**
+     *  Is the socket filter enabled?
+     *  @return bool
+     */
+    bool filter() const { return _filter; }
 };
 
 /**
@@ -0,0 +1,434 @@
+/**
+ *  Wheel.h
+ *
+ *  Internal class that implements a hierarchical timing wheel. The core
+ *  uses this to keep track of the next time at which each lookup needs
+ *  attention (to send out a new datagram, or to time out). Inserting,
+ *  removing and expiring an entry are O(1) operations.
+ *
+ *  Time is measured in ticks of one millisecond. The wheel has four levels
+ *  of 64 slots each: level 0 holds the entries that expire in the next
+ *  64 milliseconds, level 1 the entries in the next 4 seconds, level 2 the
+ *  entries in the next 4 minutes, and level 3 everything after that (entries
+ *  that are even further away are temporarily stored in the last slot).
+ *  When time proceeds, entries from the higher levels cascade down to the
+ *  lower levels. Each level has a bitmap of occupied slots, so that the
+ *  next non-empty slot can be found without scanning.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Wheel
+{
+public:
+    /**
+     *  Forward declarations
+     */
+    class List;
+
+    /**
+     *  Objects that are stored in the wheel (or in a list) should be derived from this class
+     */
+    class Entry
+    {
+    private:
+        /**
+         *  Neighbours in the list
+         *  @var Entry
+         */
+        Entry *_prev = nullptr;
+        Entry *_next = nullptr;
+
+        /**
+         *  The list in which the entry is stored
+         *  @var List
+         */
+        List *_list = nullptr;
+
+        /**
+         *  The tick at which the entry expires
+         *  @var uint64_t
+         */
+        uint64_t _expires = 0;
+
+        /**
+         *  The wheel and list classes may access the members
+         */
+        friend class Wheel;
+        friend class List;
+
+    public:
+        /**
+         *  Constructor
+         */
+        Entry() = default;
+
+        /**
+         *  No copying
+         *  @param  that
+         */
+        Entry(const Entry &that) = delete;
+
+        /**
+         *  Destructor
+         */
+        virtual ~Entry() { unlink(); }
+
+        /**
+         *  The list in which the entry is stored
+         *  @return List
+         */
+        List *list() const { return _list; }
+
+        /**
+         *  Remove the entry from the list in which it is stored
+         */
+        void unlink()
+        {
+            // not stored in a list
+            if (_list == nullptr) return;
+
+            // remove from the chain
+            _prev->_next = _next;
+            _next->_prev = _prev;
+
+            // remember the list
+            auto *list = _list;
+
+            // forget the list
+            _prev = _next = nullptr;
+            _list = nullptr;
+
+            // if the list is now empty, it is no longer marked as occupied
+            if (list->empty() && list->_bitmap) *list->_bitmap &= ~list->_bit;
+        }
+    };
+
+    /**
+     *  Intrusive double linked list of entries
+     */
+    class List
+    {
+    private:
+        /**
+         *  The sentinel (this entry itself is never part of the list)
+         *  @var Entry
+         */
+        Entry _head;
+
+        /**
+         *  The bitmap in which we mark whether the list is occupied, and our bit in that bitmap
+         *  @var uint64_t
+         */
+        uint64_t *_bitmap = nullptr;
+        uint64_t _bit = 0;
+
+        /**
+         *  The wheel and entry classes may access the members
+         */
+        friend class Wheel;
+        friend class Entry;
+
+    public:
+        /**
+         *  Constructor
+         */
+        List() { _head._prev = _head._next = &_head; }
+
+        /**
+         *  No copying
+         *  @param  that
+         */
+        List(const List &that) = delete;
+
+        /**
+         *  Destructor
+         */
+        virtual ~List()
+        {
+            // make sure that entries no longer refer to this list
+            while (!empty()) _head._next->unlink();
+        }
+
+        /**
+         *  Is the list empty?
+         *  @return bool
+         */
+        bool empty() const { return _head._next == &_head; }
+
+        /**
+         *  The first entry in the list
+         *  @return Entry
+         */
+        Entry *front() const { return empty() ? nullptr : _head._next; }
+
+        /**
+         *  Add an entry to the end of the list (it is removed from the list where it was stored before)
+         *  @param  entry
+         */
+        void push_back(Entry *entry)
+        {
+            // remove from the old list
+            entry->unlink();
+
+            // link in the chain
+            entry->_prev = _head._prev;
+            entry->_next = &_head;
+            _head._prev->_next = entry;
+            _head._prev = entry;
+            entry->_list = this;
+
+            // the list is occupied
+            if (_bitmap) *_bitmap |= _bit;
+        }
+    };
+
+private:
+    /**
+     *  Number of levels, and the number of bits that each level covers
+     *  @var size_t
+     */
+    static const size_t levels = 4;
+    static const size_t bits = 6;
+
+    /**
+     *  The slots of all levels
+     *  @var List
+     */
+    List _slots[levels][1 << bits];
+
+    /**
+     *  For each level a bitmap of the occupied slots
+     *  @var uint64_t
+     */
+    uint64_t _bitmaps[levels] = { 0 };
+
+    /**
+     *  Entries that have expired
+     *  @var List
+     */
+    List _expired;
+
+    /**
+     *  The current tick
+     *  @var uint64_t
+     */
+    uint64_t _now;
+
+    /**
+     *  Store an entry in the right slot, based on the current time
+     *  @param  entry
+     */
+    void place(Entry *entry)
+    {
+        // entries that already expired go to a special list
+        if (entry->_expires <= _now) return _expired.push_back(entry);
+
+        // entries that are too far away are temporarily stored in the last slot
+        // of the highest level, they will be placed again when that slot is reached
+        uint64_t expires = std::min(entry->_expires, _now + ((uint64_t(1) << (bits * levels)) - (uint64_t(1) << (bits * (levels - 1)))));
+
+        // find the lowest level at which the entry and the current time fall in the same block
+        size_t level = 0;
+        while (level < levels - 1 && (expires >> (bits * (level + 1))) != (_now >> (bits * (level + 1)))) ++level;
+
+        // store in the slot
+        _slots[level][(expires >> (bits * level)) & ((1 << bits) - 1)].push_back(entry);
+    }
+
+    /**
+     *  Find the first occupied slot
+     *  @param  level       level in which the slot was found
+     *  @param  slot        slot number
+     *  @return uint64_t    the tick at which the slot starts (or UINT64_MAX if all slots are empty)
+     */
+    uint64_t first(size_t &level, size_t &slot) const
+    {
+        // check all levels, the lowest levels always hold the earliest entries
+        for (level = 0; level < levels; ++level)
+        {
+            // skip empty levels
+            if (_bitmaps[level] == 0) continue;
+
+            // the slot that the current time is in
+            size_t current = (_now >> (bits * level)) & ((1 << bits) - 1);
+
+            // the slots that come after it (the current slot itself is only relevant for level 0)
+            uint64_t after = _bitmaps[level] & (~uint64_t(0) << current) & (level == 0 ? ~uint64_t(0) : ~(uint64_t(1) << current));
+
+            // the start of the block of this level
+            uint64_t block = (_now >> (bits * (level + 1))) << (bits * (level + 1));
+
+            // if there are slots after the current one, we take the first one
+            if (after) return block + ((uint64_t)(slot = __builtin_ctzll(after)) << (bits * level));
+
+            // only the highest level wraps around, the slots before the current one are in the next block
+            slot = __builtin_ctzll(_bitmaps[level]);
+            return block + (uint64_t(1) << (bits * (level + 1))) + ((uint64_t)slot << (bits * level));
+        }
+
+        // no entries at all
+        return UINT64_MAX;
+    }
+
+public:
+    /**
+     *  Constructor
+     *  @param  now         the current time
+     */
+    Wheel(double now) : _now(floor(now * 1000.0))
+    {
+        // link the slots to the bitmaps
+        for (size_t level = 0; level < levels; ++level)
+        {
+            for (size_t slot = 0; slot < (1 << bits); ++slot)
+            {
+                _slots[level][slot]._bitmap = &_bitmaps[level];
+                _slots[level][slot]._bit = uint64_t(1) << slot;
+            }
+        }
+    }
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Wheel(const Wheel &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Wheel() = default;
+
+    /**
+     *  Add an entry to the wheel (if it was already stored in the wheel or in a different
+     *  list it is moved). If the expire time has already passed, the entry immediately
+     *  ends up in the list of expired entries
+     *  @param  entry       the entry to add
+     *  @param  expires     the time at which the entry expires
+     */
+    void insert(Entry *entry, double expires)
+    {
+        // remove from the old list
+        entry->unlink();
+
+        // remember the tick at which it expires (rounded up, so that it never expires too early)
+        entry->_expires = ceil(expires * 1000.0);
+
+        // store it
+        place(entry);
+    }
+
+    /**
+     *  Proceed the wheel up to a certain time. All entries that expire at or before
+     *  this time are moved to the list of expired entries
+     *  @param  now         the current time
+     */
+    void advance(double now)
+    {
+        // the tick up to which we proceed
+        uint64_t target = floor(now * 1000.0);
+
+        // keep going until the target is reached
+        while (true)
+        {
+            // find the first occupied slot
+            size_t level = 0, slot = 0; uint64_t tick = first(level, slot);
+
+            // if that slot is still in the future, we're done
+            if (tick > target) break;
+
+            // we proceed to the start of this slot
+            _now = tick;
+
+            // all entries in this slot are either expired, or have to cascade to a lower level
+            auto &list = _slots[level][slot];
+            while (!list.empty()) place(list.front());
+        }
+
+        // update the current time
+        _now = std::max(_now, target);
+    }
+
+    /**
+     *  Lower bound of the time at which the first entry expires. This can be a little earlier
+     *  than the real time, because the entries in the higher levels are not sorted
+     *  @return double      the time, or a negative number if the wheel is empty
+     */
+    double next() const
+    {
+        // if there are expired entries, they should be handled right away
+        if (!_expired.empty()) return _now / 1000.0;
+
+        // look for the first occupied slot
+        size_t level = 0, slot = 0; uint64_t tick = first(level, slot);
+
+        // check if there was one
+        return tick == UINT64_MAX ? -1.0 : tick / 1000.0;
+    }
+
+    /**
+     *  Remove the first entry from the list of expired entries
+     *  @return Entry       nullptr if no entries have expired
+     */
+    Entry *pop()
+    {
+        // the first entry
+        auto *entry = _expired.front();
+
+        // remove it from the list
+        if (entry) entry->unlink();
+
+        // expose it
+        return entry;
+    }
+
+    /**
+     *  Get an arbitrary entry (this is used when the wheel is cleaned up)
+     *  @return Entry       nullptr if the wheel is empty
+     */
+    Entry *any() const
+    {
+        // expired entries first
+        if (!_expired.empty()) return _expired.front();
+
+        // look for an occupied slot
+        size_t level = 0, slot = 0;
+        if (first(level, slot) == UINT64_MAX) return nullptr;
+
+        // expose its first entry
+        return _slots[level][slot].front();
+    }
+
+    /**
+     *  Is the wheel empty?
+     *  @return bool
+     */
+    bool empty() const { return _expired.empty() && (_bitmaps[0] | _bitmaps[1] | _bitmaps[2] | _bitmaps[3]) == 0; }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -0,0 +1,475 @@
+/**
+ *  Wire.h
+ *
+ *  Native parser for the DNS wire format. These are the functions that we
+ *  used to borrow from libresolv (ns_initparse(), ns_name_uncompress() and
+ *  ns_samename()). The message is walked once, names are only decompressed
+ *  when they are really needed (into a buffer supplied by the caller), and
+ *  names can be compared without decompressing them at all. All methods
+ *  follow compression pointers, and protect against pointer loops.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <arpa/nameser.h>
+#include <sys/types.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Wire
+{
+private:
+    /**
+     *  Helper method to convert a character to lowercase (names are compared case-insensitive,
+     *  but only for ascii characters, see RFC 4343)
+     *  @param  c           the character
+     *  @return unsigned char
+     */
+    static unsigned char lowercase(unsigned char c)
+    {
+        return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+    }
+
+    /**
+     *  Helper method to check if a character can be copied as it is when a name is converted to
+     *  presentation format (it is printable, and it is not one of the special characters that
+     *  are escaped: '"', '$', '(', ')', '.', ';', '@' and '\\')
+     *  @param  c           the character
+     *  @return bool
+     */
+    static bool plain(unsigned char c)
+    {
+        // bitmask of the special characters (offset from 0x20, they are all below 0x60)
+        static const uint64_t special = 1ULL << 0x02 | 1ULL << 0x04 | 1ULL << 0x08 | 1ULL << 0x09 | 1ULL << 0x0e | 1ULL << 0x1b | 1ULL << 0x20 | 1ULL << 0x3c;
+
+        // check the character
+        return c > 0x20 && c < 0x7f && (c >= 0x60 || (special >> (c - 0x20) & 1) == 0);
+    }
+
+    /**
+     *  Helper method to follow compression pointers, until we end up at a label that holds data
+     *  (or at the terminating empty label)
+     *  @param  begin       begin of the message
+     *  @param  end         end of the message
+     *  @param  current     current position in the name (updated)
+     *  @param  budget      max number of bytes that can still be visited (updated, to detect loops)
+     *  @return bool        false if the name is malformed
+     */
+    static bool follow(const unsigned char *begin, const unsigned char *end, const unsigned char *&current, ssize_t &budget)
+    {
+        // walk over the pointers
+        while (current < end)
+        {
+            // the first byte of the label
+            unsigned char byte = *current;
+
+            // if this is a regular label, we are done following pointers
+            if ((byte & NS_CMPRSFLGS) == 0)
+            {
+                // the bytes of the label are visited
+                budget -= byte + 1;
+
+                // the label must fit in the message
+                return current + byte + 1 <= end;
+            }
+
+            // other label types than pointers are not supported
+            if ((byte & NS_CMPRSFLGS) != NS_CMPRSFLGS || current + 2 > end) return false;
+
+            // we do not visit more bytes than there are in the message (this protects against loops)
+            if ((budget -= 2) <= 0) return false;
+
+            // the offset to which the pointer points
+            size_t offset = (byte & ~NS_CMPRSFLGS) << 8 | current[1];
+
+            // it must point inside the message
+            if (offset >= size_t(end - begin)) return false;
+
+            // follow the pointer
+            current = begin + offset;
+        }
+
+        // the name does not fit in the message
+        return false;
+    }
+
+    /**
+     *  Helper method to read one character from a name in presentation format (like "www.example.com")
+     *  @param  name        the name, is moved to the next character
+     *  @return int         the character, or -1 if we are at the end of a label
+     */
+    static int character(const char *&name)
+    {
+        // end of the name, or end of the label
+        if (*name == '\0' || *name == '.') return -1;
+
+        // regular characters
+        if (*name != '\\') return (unsigned char)*name++;
+
+        // an escaped decimal value ("\DDD")
+        if (name[1] >= '0' && name[1] <= '9' && name[2] >= '0' && name[2] <= '9' && name[3] >= '0' && name[3] <= '9')
+        {
+            // convert the digits
+            int value = (name[1] - '0') * 100 + (name[2] - '0') * 10 + (name[3] - '0');
+
+            // skip the digits
+            name += 4;
+
+            // done
+            return value > 255 ? -1 : value;
+        }
+
+        // an escaped character, but a backslash at the end is invalid
+        if (name[1] == '\0') return -1;
+
+        // skip the escape
+        name += 2;
+
+        // expose the character
+        return (unsigned char)name[-1];
+    }
+
+public:
+    /**
+     *  Skip over a name in the message. The name is not validated: if it is a
+     *  compression pointer we do not look at what it points to.
+     *  @param  current     start of the name
+     *  @param  end         end of the message
+     *  @return const unsigned char *   first byte after the name, or nullptr on failure
+     */
+    static const unsigned char *skip(const unsigned char *current, const unsigned char *end)
+    {
+        // walk over the labels
+        while (current < end)
+        {
+            // the first byte of the label
+            unsigned char byte = *current;
+
+            // the name ends with an empty label or with a pointer to an earlier name
+            if (byte == 0) return current + 1;
+            if ((byte & NS_CMPRSFLGS) == NS_CMPRSFLGS) return current + 2 <= end ? current + 2 : nullptr;
+
+            // other extended label types are not supported
+            if (byte & NS_CMPRSFLGS) return nullptr;
+
+            // skip over the label
+            current += byte + 1;
+        }
+
+        // the name does not fit in the message
+        return nullptr;
+    }
+
+    /**
+     *  Check if a name is valid: all labels and pointers must be inside the message, there should
+     *  be no pointer loops, and the uncompressed name must not be longer than 255 bytes. A name 
+     *  that passes this check can always be decompressed into a buffer of NS_MAXDNAME bytes.
+     *  @param  begin       begin of the message
+     *  @param  end         end of the message
+     *  @param  name        start of the name
+     *  @return const unsigned char *   first byte after the name (at its original position), or nullptr if invalid
+     */
+    static const unsigned char *check(const unsigned char *begin, const unsigned char *end, const unsigned char *name)
+    {
+        // the end of the name at its original position (which is known when we see the first pointer)
+        const unsigned char *after = nullptr;
+
+        // max number of bytes we visit, and the max size of the uncompressed name
+        ssize_t budget = end - begin, length = NS_MAXCDNAME;
+
+        // walk over the labels
+        while (true)
+        {
+            // the name at its original position ends at the first pointer
+            if (after == nullptr && name < end && (*name & NS_CMPRSFLGS) == NS_CMPRSFLGS) after = name + 2;
+
+            // follow the pointers
+            if (!follow(begin, end, name, budget)) return nullptr;
+
+            // the size of the label
+            size_t bytes = *name;
+
+            // the uncompressed name is limited in size
+            if ((length -= bytes + 1) < 0) return nullptr;
+
+            // skip the label
+            name += bytes + 1;
+
+            // the empty label ends the name
+            if (bytes == 0) return after == nullptr ? name : after;
+        }
+    }
+
+    /**
+     *  Decompress a name into presentation format (this produces the same output as dn_expand(),
+     *  including the escaping of special characters, and an empty string for the root domain)
+     *  @param  begin       begin of the message
+     *  @param  end         end of the message
+     *  @param  name        start of the name
+     *  @param  buffer      buffer to which the name is written
+     *  @param  size        size of the buffer
+     *  @return ssize_t     number of bytes that the name occupies in the message, or -1 on failure
+     */
+    static ssize_t expand(const unsigned char *begin, const unsigned char *end, const unsigned char *name, char *buffer, size_t size)
+    {
+        // the start of the name, and the end of the name at its original position (which is
+        // known when we see the first pointer, or the end of the name)
+        const unsigned char *start = name, *after = nullptr;
+
+        // we need room for at least the terminating null
+        if (size == 0) return -1;
+
+        // max number of bytes we visit, and the max size of the uncompressed name
+        ssize_t budget = end - begin, length = NS_MAXCDNAME;
+
+        // the position in the output
+        size_t used = 0;
+
+        // walk over the labels
+        while (true)
+        {
+            // the name at its original position ends at the first pointer
+            if (after == nullptr && name < end && (*name & NS_CMPRSFLGS) == NS_CMPRSFLGS) after = name + 2;
+
+            // follow the pointers
+            if (!follow(begin, end, name, budget)) return -1;
+
+            // the size of the label
+            size_t bytes = *name++;
+
+            // the uncompressed name is limited in size
+            if ((length -= bytes + 1) < 0) return -1;
+
+            // the empty label ends the name
+            if (bytes == 0) break;
+
+            // labels are separated by dots
+            if (used > 0) { if (used + 1 >= size) return -1; buffer[used++] = '.'; }
+
+            // copy the characters
+            for (size_t i = 0; i < bytes; )
+            {
+                // find the characters that can be copied as they are
+                size_t run = i;
+                while (run < bytes && plain(name[run])) run += 1;
+
+                // copy them all at once
+                if (used + (run - i) >= size) return -1;
+                memcpy(buffer + used, name + i, run - i);
+                used += run - i; i = run;
+
+                // check if the label is complete
+                if (i == bytes) break;
+
+                // the character that needs escaping
+                unsigned char c = name[i++];
+
+                // characters with a special meaning are escaped
+                if (c > 0x20 && c < 0x7f)
+                {
+                    if (used + 2 >= size) return -1;
+                    buffer[used++] = '\\';
+                    buffer[used++] = c;
+                }
+                else
+                {
+                    // other non-printable characters are written as decimal value
+                    if (used + 4 >= size) return -1;
+                    buffer[used++] = '\\';
+                    buffer[used++] = '0' + c / 100;
+                    buffer[used++] = '0' + c / 10 % 10;
+                    buffer[used++] = '0' + c % 10;
+                }
+            }
+
+            // proceed with the next label
+            name += bytes;
+        }
+
+        // terminate the name
+        buffer[used] = '\0';
+
+        // number of bytes at the original position (if there was no pointer, the name ends here)
+        return (after == nullptr ? name : after) - start;
+    }
+
+    /**
+     *  Compare a name in the message with a name in presentation format (like "www.example.com"),
+     *  without decompressing the name. The comparison is case-insensitive, and a trailing dot
+     *  in the presentation name is optional (this is the same as ns_samename())
+     *  @param  begin       begin of the message
+     *  @param  end         end of the message
+     *  @param  name        start of the name in the message
+     *  @param  other       the name to compare with
+     *  @return bool
+     */
+    static bool equal(const unsigned char *begin, const unsigned char *end, const unsigned char *name, const char *other)
+    {
+        // max number of bytes we visit
+        ssize_t budget = end - begin;
+
+        // walk over the labels
+        while (true)
+        {
+            // follow the pointers
+            if (!follow(begin, end, name, budget)) return false;
+
+            // the size of the label
+            size_t bytes = *name++;
+
+            // the empty label ends the name, the other name should end too
+            if (bytes == 0) return other[0] == '\0' || (other[0] == '.' && other[1] == '\0');
+
+            // compare the characters
+            for (size_t i = 0; i < bytes; ++i)
+            {
+                // get the next character from the other name
+                int c = character(other);
+
+                // compare the characters
+                if (c < 0 || lowercase(c) != lowercase(name[i])) return false;
+            }
+
+            // the label in the other name must end here too
+            if (*other == '.') other += 1; else if (*other != '\0') return false;
+
+            // proceed with the next label
+            name += bytes;
+        }
+    }
+
+    /**
+     *  Compare two names in (possibly different) messages, without decompressing them
+     *  @param  begin1      begin of the first message
+     *  @param  end1        end of the first message
+     *  @param  name1       start of the name in the first message
+     *  @param  begin2      begin of the second message
+     *  @param  end2        end of the second message
+     *  @param  name2       start of the name in the second message
+     *  @return bool
+     */
+    static bool equal(const unsigned char *begin1, const unsigned char *end1, const unsigned char *name1, const unsigned char *begin2, const unsigned char *end2, const unsigned char *name2)
+    {
+        // max number of bytes we visit in both messages
+        ssize_t budget1 = end1 - begin1, budget2 = end2 - begin2;
+
+        // walk over the labels
+        while (true)
+        {
+            // follow the pointers in both names
+            if (!follow(begin1, end1, name1, budget1) || !follow(begin2, end2, name2, budget2)) return false;
+
+            // the size of the labels must be the same
+            size_t bytes = *name1++;
+            if (bytes != *name2++) return false;
+
+            // the empty label ends both names
+            if (bytes == 0) return true;
+
+            // compare the characters
+            for (size_t i = 0; i < bytes; ++i) if (lowercase(name1[i]) != lowercase(name2[i])) return false;
+
+            // proceed with the next label
+            name1 += bytes; name2 += bytes;
+        }
+    }
+
+    /**
+     *  Parse a message: the header is checked, and we check that all records in all sections
+     *  fit in the message. The libresolv handle is filled (so that it can still be used with
+     *  functions like ns_parserr()), and the callback is called for every record with a pointer
+     *  to the name, and a pointer to the fixed fields right after the name. This does the same
+     *  checks as ns_initparse(): compression pointers are not followed, a name that points to
+     *  garbage is only detected when it is decompressed or compared.
+     *  @param  data        the message
+     *  @param  size        size of the message
+     *  @param  handle      the handle to fill
+     *  @param  callback    function that is called for every record
+     *  @return bool        false if the message is malformed
+     */
+    template <typename CALLBACK>
+    static bool parse(const unsigned char *data, size_t size, ns_msg &handle, const CALLBACK &callback)
+    {
+        // the header must fit
+        if (size < NS_HFIXEDSZ) return false;
+
+        // the begin and end of the message
+        const unsigned char *current = data + NS_HFIXEDSZ, *end = data + size;
+
+        // fill the handle
+        handle._msg = data;
+        handle._eom = end;
+        handle._id = ns_get16(data);
+        handle._flags = ns_get16(data + 2);
+
+        // walk over all sections
+        for (int section = ns_s_qd; section < ns_s_max; ++section)
+        {
+            // the number of records in the section
+            uint16_t count = handle._counts[section] = ns_get16(data + 4 + 2 * section);
+
+            // empty sections have no position
+            handle._sections[section] = count == 0 ? nullptr : current;
+
+            // walk over the records in this section
+            for (uint16_t i = 0; i < count; ++i)
+            {
+                // skip the name (like ns_initparse() we do not follow pointers here, names are only
+                // validated when they are decompressed)
+                const unsigned char *fields = skip(current, end);
+
+                // the fixed fields after the name (questions do not have a ttl and rdlength)
+                size_t fixed = section == ns_s_qd ? NS_QFIXEDSZ : NS_RRFIXEDSZ;
+
+                // check if the fixed fields fit in the message
+                if (fields == nullptr || fields + fixed > end) return false;
+
+                // the record ends after the fixed fields and the rdata
+                const unsigned char *next = fields + fixed + (section == ns_s_qd ? 0 : ns_get16(fields + 8));
+
+                // the rdata must fit in the message too
+                if (next > end) return false;
+
+                // report the record
+                callback(current, fields);
+
+                // proceed with the next record
+                current = next;
+            }
+        }
+
+        // there should be no trailing data
+        if (current != end) return false;
+
+        // no section was selected yet (this is what ns_parserr() expects)
+        handle._sect = ns_s_max;
+        handle._rrnum = -1;
+        handle._msg_ptr = nullptr;
+
+        // done
+        return true;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -0,0 +1,355 @@
+/**
+ *  Cache.cpp
+ *
+ *  Implementation file for the Cache class
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/cache.h"
+#include "../include/dnscpp/query.h"
+#include "../include/dnscpp/response.h"
+#include "../include/dnscpp/type.h"
+#include "../include/dnscpp/record.h"
+#include "../include/dnscpp/soa.h"
+#include "compressor.h"
+#include "fingerprint.h"
+#include <string.h>
+#include <algorithm>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Helper function to write a 16bit or 32bit number to a buffer
+ *  @param  buffer      the buffer
+ *  @param  size        current size of the buffer, is updated
+ *  @param  value       value to write
+ */
+static void put16(unsigned char *buffer, size_t &size, uint16_t value) { ns_put16(value, buffer + size); size += 2; }
+static void put32(unsigned char *buffer, size_t &size, uint32_t value) { ns_put32(value, buffer + size); size += 4; }
+
+/**
+ *  Helper function to copy the records and the offsets of the TTLs of a positive response
+ *  @param  response    the response to copy
+ *  @param  data        buffer to which the response is copied
+ *  @param  ttls        offsets of the ttls in the buffer
+ *  @return uint32_t    the lowest ttl (zero if the response can not be cached)
+ */
+static uint32_t positive(const Response &response, std::vector<unsigned char> &data, std::vector<uint16_t> &ttls)
+{
+    // the lowest ttl determines how long the response can be cached
+    uint32_t ttl = UINT32_MAX;
+
+    // check all records in all sections
+    for (auto section : { ns_s_an, ns_s_ns, ns_s_ar })
+    {
+        // check all records in this section
+        for (size_t i = 0; i < response.records(section); ++i)
+        {
+            // find the record (this uses the index of the message, and does not parse the record)
+            const unsigned char *name, *fields;
+            if (!response.locate(section, i, name, fields)) return 0;
+
+            // the edns pseudo-record does not have a real ttl
+            if (ns_get16(fields) == ns_t_opt) continue;
+
+            // the ttl is stored right after the type and class
+            ttls.push_back(fields + 4 - response.data());
+
+            // update the lowest ttl
+            ttl = std::min(ttl, (uint32_t)ns_get32(fields + 4));
+        }
+    }
+
+    // copy the data
+    data.assign(response.data(), response.end());
+
+    // done
+    return ttl == UINT32_MAX ? 0 : ttl;
+}
+
+/**
+ *  Helper function to synthesize a compact negative response (NXDOMAIN or NODATA). Only the 
+ *  header, the question and the SOA record from the authority section are stored, the ttl is
+ *  the lowest value of the ttl of the SOA record and the minimum field (RFC 2308)
+ *  @param  response    the response to copy
+ *  @param  data        buffer to which the response is written
+ *  @param  ttls        offsets of the ttls in the buffer
+ *  @return uint32_t    the ttl (zero if the response can not be cached)
+ */
+static uint32_t negative(const Response &response, std::vector<unsigned char> &data, std::vector<uint16_t> &ttls)
+{
+    // look for the soa record in the authority section
+    for (size_t i = 0; i < response.nameservers(); ++i)
+    {
+        // parse the record
+        Record record;
+        if (!record.parse(response, ns_s_ns, i)) return 0;
+
+        // skip other records
+        if (record.type() != TYPE_SOA) continue;
+
+        // extract the soa data (malformed records are not cached)
+        if (!SOA::valid(response, record)) return 0;
+        SOA soa(response, record);
+
+        // the original question
+        Record question;
+        if (!question.parse(response, ns_s_qd, 0)) return 0;
+
+        // buffer for the synthesized response (the names are max 255 bytes, so this is big enough)
+        unsigned char buffer[HFIXEDSZ + 4 * MAXCDNAME + 64];
+
+        // compressor to write the names
+        Compressor compressor(buffer);
+
+        // copy the header, but with only one record in the authority section
+        memcpy(buffer, response.data(), HFIXEDSZ);
+        ns_put16(1, buffer + 4);
+        ns_put16(0, buffer + 6);
+        ns_put16(1, buffer + 8);
+        ns_put16(0, buffer + 10);
+
+        // bytes in use
+        size_t size = HFIXEDSZ;
+
+        // the question
+        auto bytes = compressor.add(question.name(), buffer + size, sizeof(buffer) - size);
+        if (bytes < 0) return 0;
+        size += bytes;
+        put16(buffer, size, question.type());
+        put16(buffer, size, question.dnsclass());
+
+        // the name of the soa record, and its type and class
+        bytes = compressor.add(record.name(), buffer + size, sizeof(buffer) - size);
+        if (bytes < 0) return 0;
+        size += bytes;
+        put16(buffer, size, TYPE_SOA);
+        put16(buffer, size, record.dnsclass());
+
+        // the ttl, we remember where it is stored
+        uint32_t ttl = std::min(record.ttl(), soa.minimum());
+        ttls.push_back(size);
+        put32(buffer, size, ttl);
+
+        // the rdata starts after the rdlength field
+        size_t rdlength = size; size += 2;
+
+        // the names in the rdata
+        bytes = compressor.add(soa.nameserver(), buffer + size, sizeof(buffer) - size);
+        if (bytes < 0) return 0;
+        size += bytes;
+        bytes = compressor.add(soa.email(), buffer + size, sizeof(buffer) - size);
+        if (bytes < 0) return 0;
+        size += bytes;
+
+        // the numbers
+        put32(buffer, size, soa.serial());
+        put32(buffer, size, soa.interval());
+        put32(buffer, size, soa.retry());
+        put32(buffer, size, soa.expire());
+        put32(buffer, size, soa.minimum());
+
+        // now we know the rdlength
+        ns_put16(size - rdlength - 2, buffer + rdlength);
+
+        // copy the data
+        data.assign(buffer, buffer + size);
+
+        // done
+        return ttl;
+    }
+
+    // without a soa record the response can not be cached
+    return 0;
+}
+
+/**
+ *  Change the memory budget (set to zero to disable the cache)
+ *  @param  bytes       max number of bytes to use
+ */
+void Cache::capacity(size_t bytes)
+{
+    // update the budget
+    _capacity = bytes;
+
+    // make sure we are within the new budget
+    shrink();
+}
+
+/**
+ *  Remove an entry
+ *  @param  iter        the entry to remove
+ */
+void Cache::erase(std::list<Entry>::iterator iter)
+{
+    // update the bookkeeping
+    _size -= iter->bytes();
+
+    // remove from the index and the list
+    _index.erase(iter->key);
+    _entries.erase(iter);
+}
+
+/**
+ *  Evict entries until we are within the budget
+ */
+void Cache::shrink()
+{
+    // the least recently used entries are at the back
+    while (_size > _capacity && !_entries.empty())
+    {
+        // remove the oldest entry
+        erase(std::prev(_entries.end()));
+
+        // update counter
+        _evictions += 1;
+    }
+}
+
+/**
+ *  Store a response in the cache (this is ignored for responses that can not be cached)
+ *  @param  query       the query that was sent
+ *  @param  response    the response that was received
+ *  @param  now         current time
+ *  @return bool        was the response stored?
+ */
+bool Cache::add(const Query &query, const Response &response, double now)
+{
+    // do nothing if the cache is disabled
+    if (_capacity == 0) return false;
+
+    // truncated responses are incomplete
+    if (response.truncated()) return false;
+
+    // offsets are stored in 16 bits
+    if (response.size() > UINT16_MAX) return false;
+
+    // construct the key
+    Fingerprint fingerprint(query);
+    if (!fingerprint.valid()) return false;
+
+    // construct the entry
+    Entry entry;
+    entry.key = fingerprint.release();
+
+    // the ttl of the entry
+    uint32_t ttl = 0;
+
+    // non-existing domains and empty answers are stored in a compact form, successful answers as they are
+    switch (response.rcode()) {
+    case ns_r_nxdomain: ttl = negative(response, entry.data, entry.ttls); break;
+    case ns_r_noerror:  ttl = response.answers() == 0 ? negative(response, entry.data, entry.ttls) : positive(response, entry.data, entry.ttls); break;
+    default:            return false;
+    }
+
+    // responses that should not be cached at all
+    if (ttl == 0) return false;
+
+    // remember the times
+    entry.stored = now;
+    entry.expires = now + ttl;
+
+    // if the entry does not fit at all, we are not going to store it
+    if (entry.bytes() > _capacity) return false;
+
+    // if there already was an entry for this key, it is replaced
+    auto found = _index.find(entry.key);
+    if (found != _index.end()) erase(found->second);
+
+    // add to the front of the list (the most recently used)
+    _entries.emplace_front(std::move(entry));
+    _index.emplace(_entries.front().key, _entries.begin());
+    _size += _entries.front().bytes();
+
+    // make sure we are within the budget
+    shrink();
+
+    // done
+    return true;
+}
+
+/**
+ *  Look up the response for a query
+ *  @param  query       the query to look up
+ *  @param  now         current time
+ *  @param  result      buffer to which the response is copied
+ *  @return bool        was the response found?
+ */
+bool Cache::fetch(const Query &query, double now, std::vector<unsigned char> &result)
+{
+    // construct the key
+    Fingerprint fingerprint(query);
+    if (!fingerprint.valid()) return false;
+
+    // look up the entry
+    auto found = _index.find(fingerprint.value());
+
+    // check if it was found
+    if (found == _index.end())
+    {
+        // one more miss
+        _misses += 1;
+
+        // not found
+        return false;
+    }
+
+    // the entry
+    auto iter = found->second;
+
+    // expired entries can be removed
+    if (iter->expires <= now)
+    {
+        // remove it, and count it as a miss
+        erase(iter); _misses += 1;
+
+        // not found
+        return false;
+    }
+
+    // this is now the most recently used entry
+    _entries.splice(_entries.begin(), _entries, iter);
+
+    // copy the response
+    result.assign(iter->data.begin(), iter->data.end());
+
+    // copy the ID from the query
+    result[0] = query.data()[0];
+    result[1] = query.data()[1];
+
+    // number of seconds that the response has been in the cache
+    uint32_t elapsed = now - iter->stored;
+
+    // rewrite the ttls
+    for (auto offset : iter->ttls) ns_put32(ns_get32(result.data() + offset) - elapsed, result.data() + offset);
+
+    // update counter
+    _hits += 1;
+
+    // done
+    return true;
+}
+
+/**
+ *  Remove all responses from the cache
+ */
+void Cache::clear()
+{
+    // forget everything
+    _entries.clear();
+    _index.clear();
+    _size = 0;
+}
+
+/**
+ *  End of namespace
+ */
+}
@@ -0,0 +1,153 @@
+/**
+ *  CachedLookup.h
+ *
+ *  Class that implements a lookup that is answered from the cache. To keep
+ *  the behavior consistent with remote lookups, the response is reported
+ *  to userspace in a later tick of the event loop (just like LocalLookup)
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/lookup.h"
+#include "../include/dnscpp/response.h"
+#include "../include/dnscpp/handler.h"
+#include <vector>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class CachedLookup : public Lookup
+{
+private:
+    /**
+     *  The response from the cache (with the ID and TTLs already rewritten)
+     *  @var std::vector
+     */
+    std::vector<unsigned char> _response;
+
+    /**
+     *  Execute the lookup. Returns true when a user-space call was made, and false when further
+     *  processing is required.
+     *  @param  now         current time
+     *  @return bool        was there a call back to userspace?
+     */
+    virtual bool execute(double now) override
+    {
+        // do nothing if ready
+        assert(!finished());
+
+        // remember the handler
+        auto *handler = _handler;
+
+        // get rid of the handler to avoid that the result is reported
+        _handler = nullptr;
+
+        // the core no longer has to keep track of this lookup
+        _core->done(this);
+
+        // pass the response to userspace (hosts from /etc/hosts still win over cached NXDOMAIN errors)
+        deliver(handler, Response(_response.data(), _response.size()));
+
+        // done
+        return true;
+    }
+
+    /**
+     *  How long should we wait until the next runtime?
+     *  @param  now         current time
+     *  @return double      delay in seconds
+     */
+    virtual double delay(double now) const override
+    {
+        // should run right away
+        return 0.0;
+    }
+
+    /**
+     *  Is this lookup still scheduled: meaning that no requests have been sent yet
+     *  @return bool
+     */
+    virtual bool scheduled() const override
+    {
+        // we return false here, because the very first call to execute() will immediately trigger a
+        // call to user-space, AS IF we already sent out one or more requests
+        return false;
+    }
+
+    /**
+     *  Is this lookup already finished: meaning that a result has been reported back to userspace
+     *  @return bool
+     */
+    virtual bool finished() const override
+    {
+        // handler is reset on completion
+        return _handler == nullptr;
+    }
+
+    /**
+     *  Is this lookup exhausted: meaning that it has sent its max number of requests, but still
+     *  has not received an appropriate answer, and is now waiting for its final timer to finish
+     *  @return bool
+     */
+    virtual bool exhausted() const override
+    {
+        // because the cached lookup does not have to send out requests, it is by definition exhausted
+        return true;
+    }
+
+    /**
+     *  Cancel the operation
+     */
+    virtual void cancel() override
+    {
+        // if already reported back to user-space
+        if (_handler == nullptr) return;
+
+        // remember the handler
+        auto *handler = _handler;
+
+        // get rid of the handler to avoid that the result is reported
+        _handler = nullptr;
+
+        // the core no longer has to keep track of this lookup
+        _core->done(this);
+
+        // the last instruction is to report it back to user-space (this also destructs `this`)
+        _core->cancel(this, handler);
+    }
+
+public:
+    /**
+     *  Constructor
+     *  @param  core        the core object
+     *  @param  query       the query that is answered
+     *  @param  response    the response from the cache
+     *  @param  handler     user space handler
+     */
+    CachedLookup(Core *core, const Query &query, std::vector<unsigned char> &&response, Handler *handler) :
+        Lookup(core, handler, query), _response(std::move(response)) {}
+
+    /**
+     *  Destructor
+     */
+    virtual ~CachedLookup() = default;
+};
+
+/**
+ *  End of namespace
+ */
+}
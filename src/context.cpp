@@ -13,7 +13,9 @@
 #include "../include/dnscpp/context.h"
 #include "remotelookup.h"
 #include "locallookup.h"
-#include "idgenerator.h"
+#include "cachedlookup.h"
+#include "sharedlookup.h"
+#include "fingerprint.h"
 
 /**
  *  Begin of namespace
@@ -27,8 +29,60 @@ namespace DNS {
 void Context::buffersize(int32_t value)
 {
     // pass to the actual sockets
-    _ipv4.buffersize(value);
-    _ipv6.buffersize(value);
+    _sockets.buffersize(value);
+}
+
+/**
+ *  Set the max number of datagrams that are received with one system call
+ *  @param  value       number of datagrams
+ */
+void Context::batchsize(size_t value)
+{
+    // pass to the actual sockets
+    _sockets.batchsize(value);
+}
+
+/**
+ *  Attach a socket filter to the UDP sockets
+ *  @param  value       the new setting
+ */
+void Context::filter(bool value)
+{
+    // pass to the actual sockets
+    _sockets.filter(value);
+}
+
+/**
+ *  Use a connected UDP socket for every nameserver
+ *  @param  value       the new setting
+ */
+void Context::connected(bool value)
+{
+    // pass to the actual sockets
+    _sockets.connected(value);
+}
+
+/**
+ *  Set the lifetime of the UDP sockets
+ *  @param  queries     max number of queries per port (zero for no limit)
+ *  @param  seconds     max number of seconds per port (zero for no limit)
+ *  @param  idle        number of seconds after which an idle socket is closed anyway
+ */
+void Context::lifetime(size_t queries, double seconds, double idle)
+{
+    // pass to the actual sockets
+    _sockets.lifetime(queries, seconds, idle);
+}
+
+/**
+ *  Keep TCP connections open after use
+ *  @param  connections max number of unused connections to keep open (zero to disable)
+ *  @param  seconds     max number of seconds to keep an unused connection open
+ */
+void Context::pool(size_t connections, double seconds)
+{
+    // pass to the actual sockets
+    _sockets.pool(connections, seconds);
 }
 
 /**
@@ -37,8 +91,8 @@ void Context::buffersize(int32_t value)
  */
 void Context::capacity(size_t value)
 {
-    // store property
-    _capacity = std::min((size_t)IdGenerator::capacity(), std::max(size_t(1), value));
+    // store property (the number of sockets limits the capacity too, see Core::capacity())
+    _capacity = std::max(size_t(1), value);
 }
 
 /**
@@ -58,8 +112,30 @@ Operation *Context::query(const char *domain, ns_type type, const Bits &bits, DN
     // the request can throw (for example when the domain is invalid
     try
     {
+        // construct the query
+        Query query(ns_o_query, domain, type, bits);
+        
+        // buffer for a response from the cache
+        std::vector<unsigned char> response;
+        
+        // if the response is in the cache, we can report it in the next tick of the event loop
+        if (_cache.enabled() && _cache.fetch(query, Now(), response)) return add(new CachedLookup(this, query, std::move(response), handler));
+        
+        // the fingerprint to find identical queries that are already in progress
+        Fingerprint fingerprint(query);
+        
+        // if an identical query is already in progress, we wait for its result instead of sending the query too
+        auto iter = fingerprint.valid() ? _shared.find(fingerprint.value()) : _shared.end();
+        if (iter != _shared.end()) return iter->second->attach(new SharedLookup(this, iter->second, query, handler));
+        
         // we are going to create a self-destructing request
-        return add(new RemoteLookup(this, domain, type, bits, handler));
+        auto *lookup = new RemoteLookup(this, query, fingerprint, handler);
+        
+        // future identical queries can share this lookup
+        if (fingerprint.valid()) _shared[fingerprint.value()] = lookup;
+        
+        // pass on to the core
+        return add(lookup);
     }
     catch (...)
     {
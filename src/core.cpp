@@ -14,6 +14,7 @@
 #include "../include/dnscpp/lookup.h"
 #include "../include/dnscpp/loop.h"
 #include "../include/dnscpp/watcher.h"
+#include "../include/dnscpp/handler.h"
 
 /**
  *  Begin of namespace
@@ -29,8 +30,9 @@ namespace DNS {
  */
 Core::Core(Loop *loop, bool defaults) :
     _loop(loop),
-    _ipv4(loop, this),
-    _ipv6(loop, this)
+    _sockets(loop, this),
+    _lookups(Now()),
+    _trigger(this)
 {
     // do nothing if we don't need the defaults
     if (!defaults) return;
@@ -59,8 +61,9 @@ Core::Core(Loop *loop, bool defaults) :
  */
 Core::Core(Loop *loop, const ResolvConf &settings) :
     _loop(loop),
-    _ipv4(loop, this),
-    _ipv6(loop, this)
+    _sockets(loop, this),
+    _lookups(Now()),
+    _trigger(this)
 {
     // construct the nameservers
     for (size_t i = 0; i < settings.nameservers(); ++i) _nameservers.emplace_back(settings.nameserver(i));
@@ -78,11 +81,14 @@ Core::Core(Loop *loop, const ResolvConf &settings) :
  */
 Core::~Core()
 {
-    // stop timer (in case it is still running)
-    if (_timer == nullptr) return;
-    
-    // stop the timer
-    _loop->cancel(_timer, this);
+    // destruct all lookups that are still in progress, scheduled, or finished
+    while (auto *entry = _lookups.any()) delete static_cast<Lookup *>(entry);
+    while (auto *entry = _scheduled.front()) delete static_cast<Lookup *>(entry);
+    while (auto *entry = _finished.front()) delete static_cast<Lookup *>(entry);
+
+    // stop the timers (in case they are still running)
+    if (_timer != nullptr) _loop->cancel(_timer, this);
+    if (_immediate != nullptr) _loop->cancel(_immediate, &_trigger);
 }
 
 /**
@@ -98,41 +104,31 @@ Operation *Core::add(Lookup *lookup)
     // us to make things more efficient (for example by immediately calling execute() without first 
     // going back to the event-loop because we KNOW that execute() will not trigger a user space call)
     
+    // we need the current time
+    Now now;
+    
     // in case the lookup is already exhausted (no more udp messages have to be sent), we can
-    // put it in the ready-queue right away (in reality this means that this is a LocalLookup)
+    // put it in the wheel right away (in reality this means that this is a LocalLookup)
     if (lookup->exhausted())
     {
-        // IN THEORY we should call delay(), and put it either on the front or the end of the queue
-        // based on that -- but in this case we know that this code is only executed for local-lookups 
-        // and the delay for those lookups is hardcoded to 0.0 anyway
-        _ready.emplace_front(lookup);
-        
         // we consider this lookup to be active (note that we might exceed _capacity now, but we're
         // ok with that as this is a local-lookup that does not put any stress on nameservers)
         _inflight += 1;
         
-        // expire soon so that it is picked up and reported to user space
-        timer(0.0);
+        // the delay of a local lookup is zero, so this ends up in the list of expired lookups,
+        // and it is picked up and reported to user space in the next iteration
+        schedule(lookup, now);
     }
-    else if (_capacity <= _inflight || _nameservers.empty())
+    else if (capacity() <= _inflight || _nameservers.empty())
     {
-        // we are going to update _scheduled, check if this is the first time
-        bool wasempty = _scheduled.empty();
-        
         // this is a remote-lookup, but we have too many operations already in progress so we
         // delay sending out the first datagram (or, unlikely, there are no nameservers configured, 
         // meaning that a call to lookup::execute() would trigger a call to userspace, which we want 
         // to avoid to keep all callbacks ASYNC, so we also want to delay the call to execute())
-        _scheduled.emplace_back(lookup);
-        
-        // make sure the timer expires in time
-        if (wasempty) reschedule(Now{});
+        _scheduled.push_back(lookup);
     }
     else
     {
-        // we need the current time
-        Now now;
-        
         // THEORETICALLY, we should not immediately call execute() because that might trigger a
         // call to user-space (while user-space expects ASYNC callbacks). However, since this code
         // is in REALITY only used for RemoteLookups and we know for sure that there are nameservers
@@ -143,58 +139,84 @@ Operation *Core::add(Lookup *lookup)
         // the operation is in progress
         _inflight += 1;
         
-        // we are going to update _lookups, check if this was the first time
-        bool wasempty = _lookups.empty();
-        
-        // put it at the back of the queue to schedule it for repeating the call
-        _lookups.emplace_back(lookup);
-        
-        // we might have to set a timer
-        if (wasempty) reschedule(now);
+        // store it in the wheel for repeating the call
+        schedule(lookup, now);
     }
+    
+    // we might have to set the timer
+    reschedule(now);
         
     // expose the operation
     return lookup;
 }
 
 /**
- *  Calculate the delay until the next job
- *  @return double      the delay in seconds (or < 0 if there is no need to run a timer)
+ *  Store a lookup in the wheel, based on the time of its next step
+ *  @param  lookup      the lookup to store
+ *  @param  now         current time
+ */
+void Core::schedule(Lookup *lookup, double now)
+{
+    // add to the wheel
+    _lookups.insert(lookup, now + lookup->delay(now));
+}
+
+/**
+ *  Make sure that the next step of a lookup is taken right away
+ *  @param  lookup      the lookup that should run
+ */
+void Core::expedite(Lookup *lookup)
+{
+    // the lookup is moved to the list of expired lookups in the wheel
+    _lookups.insert(lookup, 0.0);
+
+    // and we make sure that the lookups are soon processed
+    onActive(nullptr);
+}
+
+/**
+ *  Calculate the time of the next job
+ *  @param  now         current time
+ *  @return double      the time (or < 0 if there is no need to run a timer)
  */
-double Core::delay(double now)
+double Core::next(double now) const
 {
     // if there is an unprocessed inbound queue, we have to expire asap
-    if (_ipv4.active() || _ipv6.active()) return 0.0;
-    
-    // if there is nothing scheduled
-    if (_lookups.empty() && _ready.empty()) return -1.0;
+    if (_sockets.active()) return now;
     
-    // if only one is set
-    if (_lookups.empty()) return _ready.front()->delay(now);
-    if (_ready.empty()) return _lookups.front()->delay(now);
+    // if there are scheduled lookups that can be started, we also have to expire asap
+    if (!_scheduled.empty() && _inflight < capacity()) return now;
     
-    // get the minimum
-    return std::min(_lookups.front()->delay(now), _ready.front()->delay(now));
+    // otherwise the wheel knows
+    return _lookups.next();
 }
 
 /**
- *  Set the timer to a certain period
- *  @param  seconds     expire time
+ *  Set the timers to a certain time
+ *  @param  now         current time
+ *  @param  expires     time at which the timer should expire (or < 0 if no timer is needed)
  */
-void Core::timer(double seconds)
+void Core::timer(double now, double expires)
 {
+    // if there is work to do right away we use the immediate timer
+    if (expires >= 0.0 && expires <= now) return onActive(nullptr);
+    
     // if timer was not set and will not be set
-    if (seconds < 0.0 && _timer == nullptr) return;
+    if (expires < 0.0 && _timer == nullptr) return;
     
-    // if timer was immediate and stays immediate, not changes are needed
-    if (seconds == 0.0 && _timer != nullptr && _immediate) return;
+    // if the timer already expires in time, no changes are needed (it is not a problem if 
+    // the timer expires too early, because then we simply set a new timer at that time)
+    if (expires >= 0.0 && _timer != nullptr && _expires <= expires) return;
 
     // if the timer is already running we have to reset it
     if (_timer != nullptr) _loop->cancel(_timer, this);
     
-    // check when the next operation should run
-    _timer = seconds < 0 ? nullptr : _loop->timer(seconds, this);
-    _immediate = seconds == 0.0;
+    // if there is no more work to do we do not need a timer
+    if (expires < 0.0) { _timer = nullptr; return; }
+    
+    // set the new timer
+    _timer = _loop->timer(expires - now, this);
+    _expires = expires;
 }
 
 /**
@@ -203,8 +225,8 @@ void Core::timer(double seconds)
  */
 void Core::reschedule(double now)
 {
-    // calculate the delay
-    timer(delay(now));
+    // calculate the time of the next job
+    timer(now, next(now));
 }
 
 /**
@@ -214,50 +236,34 @@ void Core::reschedule(double now)
 void Core::onActive(Sockets *sockets)
 {
     // if we already had an immediate timer we do not have to set it
-    if (_timer != nullptr && _immediate) return;
+    if (_immediate != nullptr) return;
 
-    // if the timer is already running we have to reset it
-    if (_timer != nullptr) _loop->cancel(_timer, this);
-
-    // check when the next operation should run
-    _timer = _loop->timer(0.0, this);
-    _immediate = true;
+    // set the timer
+    _immediate = _loop->timer(0.0, &_trigger);
 }
 
 /**
  *  Process a lookup, which means that the next action for the lookup should be taken (like repeating a datagram or timing out)
  *  @param  watcher     object to monitor if `this` was destructed
- *  @param  lookup      the lookup to process
+ *  @param  lookup      the lookup to process (it has already been removed from the wheel)
  *  @param  now         current time
- *  @return bool        was this lookup indeed processable (false if processed too early)
+ *  @return bool        was there a call to userspace?
  */
-bool Core::process(const Watcher &watcher, const std::shared_ptr<Lookup> &lookup, double now)
+bool Core::process(const Watcher &watcher, Lookup *lookup, double now)
 {
-    // if this lookup was already finished (this just pops it off the queue), this happens because we only
-    // pop messages from the queues, and lookups in the middle might already be finished by the time the
-    // hit the front of the queue)
-    if (lookup->finished()) return true;
+    // run the lookup if it is time to do so (if this succeeds a call to userspace was made, which means 
+    // the operation is done), lookups that are not yet due (because they were postponed) are put back
+    if (lookup->delay(now) <= 0.0 && lookup->execute(now)) return true;
     
-    // if it is not yet time to run this lookup, we do nothing more
-    if (lookup->delay(now) > 0.0) return false;
+    // the lookup might have finished in a different way
+    if (lookup->finished()) return false;
 
-    // run the lookup (if this succeeds a call to userspace was made, which means the operation is done)
-    bool success = lookup->execute(now);
-    
-    // if user-space destructed `this` there is nothing else to do
-    if (success && !watcher.valid()) return true;
-    
-    // update counter if call was completed
-    if (success) _inflight -= 1;
-
-    // if no more attempts are expected, we put it in a special list
-    else if (lookup->exhausted()) _ready.push_back(lookup);
-    
-    // remember the lookup for the next attempt
-    else _lookups.push_back(lookup);
+    // remember the lookup for the next attempt (we make sure that it is not expired right 
+    // away, to prevent that we end up in an endless loop with a lookup that runs slightly early)
+    _lookups.insert(lookup, now + std::max(lookup->delay(now), 0.001));
     
-    // done
-    return true;
+    // no call to userspace
+    return false;
 }
 
 /**
@@ -268,28 +274,50 @@ bool Core::process(const Watcher &watcher, const std::shared_ptr<Lookup> &lookup
 void Core::proceed(const Watcher &watcher, double now)
 {
     // make sure this is absolutely true or we'll end up iterating for a long time
-    assert(_inflight <= _capacity);
+    assert(_inflight <= capacity());
 
     // iterate
-    while (watcher.valid() && _capacity > _inflight && !_scheduled.empty())
+    while (watcher.valid() && capacity() > _inflight && !_scheduled.empty())
     {
         // the lookup that will be started
-        auto lookup = _scheduled.front();
+        auto *lookup = static_cast<Lookup *>(_scheduled.front());
 
         // this lookup is no longer scheduled
-        _scheduled.pop_front();
-        
-        // it is possible that scheduled operations are already cancelled
-        if (lookup->finished()) continue;
+        lookup->unlink();
         
         // this is now in progress
         _inflight += 1;
         
-        // run it, the process() always returns true
+        // run it
         process(watcher, lookup, now);
     }
 }
 
+/**
+ *  Mark a lookup as finished
+ *  @param  lookup
+ */
+void Core::done(Lookup *lookup)
+{
+    // ignore lookups that were already finished
+    if (lookup->list() == &_finished) return;
+    
+    // if the operation was already included in the _inflight counter, there is one operation less active
+    if (lookup->list() != &_scheduled) _inflight -= 1;
+    
+    // move it to the list of finished lookups (this also removes it from the wheel)
+    _finished.push_back(lookup);
+}
+
+/**
+ *  Destruct the lookups that have finished
+ */
+void Core::purge()
+{
+    // remove them one by one
+    while (auto *entry = _finished.front()) delete static_cast<Lookup *>(entry);
+}
+
 /**
  *  Method that is called when the timer expires
  */
@@ -298,6 +326,30 @@ void Core::expire()
     // forget the timer
     _loop->cancel(_timer, this); _timer = nullptr;
     
+    // run the jobs
+    run();
+}
+
+/**
+ *  Method that is called when the immediate timer expires
+ */
+void Core::Immediate::expire()
+{
+    // forget the timer
+    _core->_loop->cancel(_core->_immediate, this); _core->_immediate = nullptr;
+    
+    // run the jobs
+    _core->run();
+}
+
+/**
+ *  Run all jobs that should run now
+ */
+void Core::run()
+{
+    // lookups that finished since the previous run are no longer on the stack
+    purge();
+    
     // a call to userspace might destruct `this`
     Watcher watcher(this);
     
@@ -305,52 +357,40 @@ void Core::expire()
     Now now;
     
     // first we check the udp sockets to see if they have data availeble
-    size_t ipv4calls = _ipv4.deliver(_maxcalls); if (!watcher.valid()) return;
-    size_t ipv6calls = _ipv6.deliver(_maxcalls - ipv4calls); if (!watcher.valid()) return;
+    size_t calls = _sockets.deliver(_maxcalls); if (!watcher.valid()) return;
     
-    // if there were calls to userspace, we must update our bookkeeping
-    _inflight -= (ipv4calls + ipv6calls);
+    // number of calls to userspace left (the sockets should not have used more than the budget, but we
+    // make sure that the counter does not wrap around)
+    size_t callsleft = calls < _maxcalls ? _maxcalls - calls : 0;
 
-    // number of calls to userspace left
-    size_t callsleft = _maxcalls - ipv4calls - ipv6calls;
+    // move the lookups that need attention to the list of expired lookups
+    _lookups.advance(now);
 
-    // there was no data to process, so we are going to run jobs
-    while (callsleft > 0 && !_lookups.empty())
+    // process the lookups that expired
+    while (callsleft > 0)
     {
-        // get the oldest operation from the queue
-        if (!process(watcher, _lookups.front(), now)) break;
+        // get the next expired lookup (this also removes it from the wheel)
+        auto *entry = _lookups.pop();
+        
+        // leap out if there are no more lookups
+        if (entry == nullptr) break;
+        
+        // process it
+        if (!process(watcher, static_cast<Lookup *>(entry), now)) continue;
         
         // maybe the userspace call ended up in `this` being destructed
         if (!watcher.valid()) return;
         
         // log one extra call 
-        // @todo this is not entirely correct, maybe there was no call to userspace
-        callsleft -= 1;
-
-        // forget this lookup because we ran it
-        // @todo what if there was no call to userspace?
-        _lookups.pop_front();
-    }
-    
-    // look at lookups that can no longer be repeated, but for which we're waiting for answer
-    while (callsleft > 0 && !_ready.empty())
-    {
-        // get the oldest operation
-        if (!process(watcher, _ready.front(), now)) break;
-
-        // maybe the userspace call ended up in `this` being destructed
-        if (!watcher.valid()) return;
-
-        // log one extra call
         callsleft -= 1;
-        
-        // forget this lookup because we are going to run it
-        _ready.pop_front();
     }
 
     // execute more lookups if possible
     proceed(watcher, now);
 
+    // all queries that were produced in this pass can now be sent in one go
+    _sockets.flush();
+
     // reset the timer
     reschedule(now);
 }
@@ -359,16 +399,13 @@ void Core::expire()
  *  Send a message over a UDP socket
  *  @param  ip              target IP
  *  @param  query           the query to send
+ *  @param  id              the ID with which the query was sent (output parameter)
  *  @return Inbound         the object that receives the answer
  */
-Inbound *Core::datagram(const Ip &ip, const Query &query)
+Inbound *Core::datagram(const Ip &ip, const Query &query, uint16_t &id)
 {
-    // check the version number of ip
-    switch (ip.version()) {
-    case 4:     return _ipv4.datagram(ip, query);
-    case 6:     return _ipv6.datagram(ip, query);
-    default:    return nullptr;
-    }
+    // pass on to the sockets (they are dual-stack)
+    return _sockets.datagram(ip, query, id);
 }
 
 /**
@@ -380,31 +417,31 @@ Inbound *Core::datagram(const Ip &ip, const Query &query)
  */
 Connecting *Core::connect(const Ip &ip, Connector *connector)
 {
-    // check the version number of ip
-    switch (ip.version()) {
-    case 4:     return _ipv4.connect(ip, connector);
-    case 6:     return _ipv6.connect(ip, connector);
-    default:    return nullptr;
-    }
+    // pass on to the sockets
+    return _sockets.connect(ip, connector);
 }
 
 /**
- *  Mark a lookup as cancelled and start more queues lookups
- *  @param  lookup
+ *  Report to userspace that a lookup was cancelled, and destruct it right away
+ *  @param  lookup      the lookup that was cancelled (and on which done() was already called)
+ *  @param  handler     the user space handler to notify
  */
-void Core::cancel(const Lookup *lookup)
+void Core::cancel(Lookup *lookup, DNS::Handler *handler)
 {
-    // if the operation was not yet included in the _inflight counter
-    if (lookup->scheduled()) return;
+    // a call to userspace might destruct `this`
+    Watcher watcher(this);
+    
+    // report to user space
+    handler->onCancelled(lookup);
     
-    // one operation less active
-    _inflight -= 1;
+    // if `this` was destructed, the lookup was destructed too
+    if (!watcher.valid()) return;
     
-    // is there room for more operations, and do we have them?
-    if (_inflight >= _capacity || _scheduled.empty()) return;
+    // the lookup is no longer needed
+    delete lookup;
     
-    // start a timer to start more operations
-    timer(0.0);
+    // there might be room for more operations, or there might no longer be a need for a timer
+    reschedule(Now());
 }
 
 /**
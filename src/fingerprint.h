@@ -0,0 +1,125 @@
+/**
+ *  Fingerprint.h
+ *
+ *  Class that turns a query into a string that identifies the question that
+ *  is asked: the name (in lowercase), the type and class, the AD and CD bits 
+ *  from the header, and the EDNS pseudo-record (that holds the DO bit). Two
+ *  queries with the same fingerprint can be answered with the same response
+ *  (apart from the ID). It is used as key in the cache, and to find lookups 
+ *  for the same question that are already in progress.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/query.h"
+#include <ctype.h>
+#include <string>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Fingerprint
+{
+private:
+    /**
+     *  The fingerprint (empty if the query can not be fingerprinted)
+     *  @var std::string
+     */
+    std::string _value;
+
+    /**
+     *  Helper method to construct the fingerprint
+     *  @param  query       the query
+     *  @return bool        could the fingerprint be constructed?
+     */
+    bool construct(const Query &query)
+    {
+        // the raw data
+        const unsigned char *data = query.data(), *end = data + query.size();
+
+        // we only support queries with exactly one question
+        if (query.opcode() != ns_o_query || query.questions() != 1) return false;
+
+        // the name starts right after the header
+        const unsigned char *current = data + HFIXEDSZ;
+
+        // start with the AD and CD bits
+        _value.assign(1, (char)(data[3] & 0x30));
+
+        // copy the labels
+        while (current < end && *current != 0)
+        {
+            // compression pointers are not expected in a query
+            if ((*current & 0xc0) != 0 || current + 1 + *current > end) return false;
+
+            // add the label in lowercase
+            _value.push_back(*current);
+            for (size_t i = 1; i <= *current; ++i) _value.push_back(tolower(current[i]));
+
+            // proceed to the next label
+            current += 1 + *current;
+        }
+
+        // there must be room for the terminating byte, and the type and class
+        if (end - current < 5) return false;
+
+        // the rest of the query (the type, the class and the edns record) is copied as is
+        _value.append((const char *)current, end - current);
+
+        // done
+        return true;
+    }
+
+public:
+    /**
+     *  Constructor
+     *  @param  query       the query
+     */
+    Fingerprint(const Query &query)
+    {
+        // on failure we keep an empty fingerprint
+        if (!construct(query)) _value.clear();
+    }
+
+    /**
+     *  Destructor
+     */
+    virtual ~Fingerprint() = default;
+
+    /**
+     *  Is the fingerprint valid? (false for queries with an unexpected format)
+     *  @return bool
+     */
+    bool valid() const { return !_value.empty(); }
+
+    /**
+     *  Expose the fingerprint
+     *  @return std::string
+     */
+    const std::string &value() const { return _value; }
+
+    /**
+     *  Move the fingerprint out of the object
+     *  @return std::string
+     */
+    std::string release() { return std::move(_value); }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -22,23 +22,24 @@ namespace DNS {
  *  @param  processor       the object that no longer is active
  *  @param  ip              the IP to which it was listening to
  *  @param  id              the query ID in which it was interested
+ *  @param  original        the ID of the original query
  */
-void Inbound::subscribe(Processor *processor, const Ip &ip, uint16_t id)
+void Inbound::subscribe(Processor *processor, const Ip &ip, uint16_t id, uint16_t original)
 {
-    // add to the set
-    _processors.emplace(id, ip, processor);
+    // add to the table
+    _processors.add(processor, ip, id, original);
 }
 
 /**
- *  Remove a processor from the set
+ *  Remove a processor from the table
  *  @param  processor       the object that no longer is active
  *  @param  ip              the IP to which it was listening to
  *  @param  id              the query ID in which it was interested
  */
 void Inbound::unsubscribe(Processor *processor, const Ip &ip, uint16_t id)
 {
-    // remove from the set
-    _processors.erase(std::make_tuple(id, ip, processor));
+    // remove from the table
+    _processors.remove(processor, ip, id);
     
     // if there are no more subscribers we reset the object
     if (_processors.empty()) reset();
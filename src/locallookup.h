@@ -52,6 +52,9 @@ private:
         
         // get rid of the handler to avoid that the result is reported
         _handler = nullptr;
+        
+        // the core no longer has to keep track of this lookup
+        _core->done(this);
 
         // pass to the hosts (this will trigger an immediate call to the handler)
         _hosts.notify(Request(this), handler, this);
@@ -111,19 +114,17 @@ private:
         // if already reported back to user-space
         if (_handler == nullptr) return;
         
-        // notify the core object so that it can schedule more things
-        // NOTE that this is not so elegant, as it is not the responsibility of the Lookup class 
-        // to keep the bookkeeping of the Core class correct
-        _core->cancel(this);
-        
         // remember the handler
         auto *handler = _handler;
-        
+
         // get rid of the handler to avoid that the result is reported
         _handler = nullptr;
         
-        // the last instruction is to report it back to user-space
-        handler->onCancelled(this);
+        // the core no longer has to keep track of this lookup
+        _core->done(this);
+
+        // the last instruction is to report it back to user-space (this also destructs `this`)
+        _core->cancel(this, handler);
     }
 
     
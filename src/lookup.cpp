@@ -0,0 +1,60 @@
+/**
+ *  Lookup.cpp
+ *
+ *  Implementation file for the Lookup class
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/lookup.h"
+#include "../include/dnscpp/core.h"
+#include "../include/dnscpp/response.h"
+#include "../include/dnscpp/handler.h"
+#include "../include/dnscpp/question.h"
+#include "../include/dnscpp/request.h"
+#include "fakeresponse.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Pass a response to userspace
+ *  This method checks if there is an NXDOMAIN error, if that is the case
+ *  it is turned into an empty response if the /etc/hosts file holds a record for the host
+ *  @param  handler     the user space handler
+ *  @param  response    the response to report
+ */
+void Lookup::deliver(Handler *handler, const Response &response)
+{
+    // for NXDOMAIN errors we need special treatment (maybe the hostname _does_ exists in 
+    // /etc/hosts?) For all other type of results the message can be passed to userspace
+    if (response.rcode() != ns_r_nxdomain) return handler->onReceived(this, response);
+
+    // extract the original question, to find out the host for which we were looking
+    Question question;
+    if (!question.parse(response, ns_s_qd, 0)) return handler->onReceived(this, response);
+    
+    // there was a NXDOMAIN error, which we should not communicate if our /etc/hosts
+    // file does have a record for this hostname, check this
+    if (!_core->exists(question.name())) return handler->onReceived(this, response);
+    
+    // get the original request (so that the response can match the request)
+    Request request(this);
+    
+    // construct a fake-response message (it is fake because we have not actually received it)
+    FakeResponse fake(request, question);
+
+    // send the fake-response to user-space
+    handler->onReceived(this, Response(fake.data(), fake.size()));
+}
+
+/**
+ *  End of namespace
+ */
+}
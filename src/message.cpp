@@ -11,48 +11,76 @@
  *  Dependencies
  */
 #include "../include/dnscpp/message.h"
-#include "../include/dnscpp/additional.h"
+#include "../include/dnscpp/record.h"
 #include "../include/dnscpp/type.h"
 #include "../include/dnscpp/opt.h"
+#include <resolv.h>
 
 /**
  *  Begin of namespace
  */
 namespace DNS {
 
+/**
+ *  Find the position of a record in the message
+ *  @param  section     the type of section
+ *  @param  index       the record-number inside the section
+ *  @param  name        pointer to the name (output parameter)
+ *  @param  fields      pointer to the fixed fields (output parameter)
+ *  @return bool        does the record exist?
+ */
+bool Message::locate(ns_sect section, size_t index, const unsigned char *&name, const unsigned char *&fields) const
+{
+    // check if the section has that many records
+    if (section < ns_s_qd || section >= ns_s_max || index >= records(section)) return false;
+    
+    // the position in the index (the records of the previous sections come first)
+    for (int i = ns_s_qd; i < section; ++i) index += records((ns_sect)i);
+    
+    // the position of the record
+    const Position &position = index < 16 ? _positions[index] : _overflow[index - 16];
+    
+    // expose the pointers
+    name = data() + position.name;
+    fields = data() + position.fields;
+    
+    // done
+    return true;
+}
+
 /**
  *  The opcode, see arpa/nameser.h for supported opcodes
  *  @return ns_rcode
  */
 ns_rcode Message::rcode() const 
 {
+    // use the cached value if possible
+    if (_rcode >= 0) return ns_rcode(_rcode);
+    
     // get the code from the regular header
-    auto rcode = ns_msg_getflag(_handle, ns_f_rcode);
+    _rcode = ns_msg_getflag(_handle, ns_f_rcode);
     
     // if this is an EDNS message, there are extra rcode bits 
     for (size_t i = 0; i < additional(); ++i)
     {
-        // prevent exceptions in case this is not an OPT record
-        try
-        {
-            // additional record
-            Additional additional(*this, i);
-    
-            // treat the additional record as an OPT record
-            OPT record(*this, additional);
+        // find the record
+        const unsigned char *name, *fields;
+        if (!locate(ns_s_ar, i, name, fields)) break;
+        
+        // skip records that are not OPT records (without parsing them)
+        if (ns_get16(fields) != ns_t_opt) continue;
+
+        // parse the record (this does not throw, so that malformed records do not cost much)
+        Record record;
+        if (!record.parse(*this, ns_s_ar, i) || !OPT::valid(record)) continue;
         
-            // if we're here we have indeed found the OPT record, and
-            // should add the extra eight bits
-            return ns_rcode(rcode | (record.rcode() << 4));
-        }
-        catch (...)
-        {
-            // OPT record could not be parsed, ignore this
-        }
+        // if we're here we have indeed found the OPT record, and
+        // should add the extra eight bits
+        return ns_rcode(_rcode |= (OPT(*this, record).rcode() << 4));
     }
     
     // no OPT record found, fallback to the original RCODE
-    return ns_rcode(rcode);
+    return ns_rcode(_rcode);
 }
 
 /**
@@ -62,7 +90,7 @@ ns_rcode Message::rcode() const
  *  @param  dnsclass    the dnsclass
  *  @return uint16_t
  */
-uint16_t Message::records(ns_sect section, uint16_t type, uint16_t dnsclass)
+uint16_t Message::records(ns_sect section, uint16_t type, uint16_t dnsclass) const
 {
     // the result
     size_t result = 0;
@@ -73,16 +101,12 @@ uint16_t Message::records(ns_sect section, uint16_t type, uint16_t dnsclass)
     // iterate over the records
     for (size_t i = 0; i < max; ++i)
     {
-        // avoid exceptions
-        try
-        {
-            // parse the record
-            Record record(*this, section, i);
-            
-            // do we have a match
-            if (record.type() == type && record.dnsclass() == dnsclass) result += 1;
-        }
-        catch (...) {}
+        // find the record
+        const unsigned char *name, *fields;
+        if (!locate(section, i, name, fields)) break;
+        
+        // do we have a match (we can read the type and class without parsing the entire record)
+        if (ns_get16(fields) == type && ns_get16(fields + 2) == dnsclass) result += 1;
     }
     
     // done
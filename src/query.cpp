@@ -17,9 +17,8 @@
 #include <stdexcept>
 #include "compressor.h"
 #include "../include/dnscpp/type.h"
-#include "../include/dnscpp/question.h"
 #include "../include/dnscpp/response.h"
-#include "../include/dnscpp/decompressed.h"
+#include "../include/dnscpp/wire.h"
 #include "idgenerator.h"
 
 /**
@@ -123,49 +122,34 @@ Query::Query(int op, const char *dname, int type, const Bits &bits, const unsign
 }
 
 /**
- *  Does this query contain a specific record as question?
- *  @param  record
+ *  Does this query contain a specific question from a response?
+ *  @param  response    the response
+ *  @param  index       the question-number in the response
  *  @return bool
  */
-bool Query::contains(const Question &record) const
+bool Query::contains(const Response &response, size_t index) const
 {
+    // find the question in the response
+    const unsigned char *name, *fields;
+    if (!response.locate(ns_s_qd, index, name, fields)) return false;
+    
     // start of the buffer
     auto *current = _buffer.data() + HFIXEDSZ;
     
     // check all questions
     for (size_t i = 0; i < questions(); ++i)
     {
-        // prevent errors if name could not be extracted
-        try
-        {
-            // decompress the name
-            Decompressed name(_buffer.data(), end(), current);
+        // skip over the name
+        auto *after = Wire::skip(current, end());
+        
+        // check if we still have room for two uint16's
+        if (after == nullptr || end() - after < 4) break;
         
-            // update current pointer to pass the consumed bytes 
-            current += name.consumed();
+        // the type and class must be the same, and then the name (which is compared without decompressing it)
+        if (memcmp(after, fields, 4) == 0 && Wire::equal(_buffer.data(), end(), current, response.data(), response.end(), name)) return true;
         
-            // check if we still have room for two uint16's
-            if (end() - current < 4) break;
-            
-            // get the next two shorts
-            uint16_t type = ns_get16(current);
-            uint16_t dnsclass = ns_get16(current + 2);
-            
-            // update current pointer
-            current += 4;
-            
-            // now run the tests
-            if (type != record.type()) continue;
-            if (dnsclass != record.dnsclass()) continue;
-            
-            // type and class are then same, we just need the same name
-            if (ns_samename(name, record.name()) > 0) return true;
-        }
-        catch (...)
-        {
-            // ignore the unparsable record
-            continue;
-        }
+        // proceed with the next question
+        current = after + 4;
     }
         
     // record not found
@@ -233,6 +217,19 @@ uint16_t Query::id() const noexcept
     return ntohs(header->id);
 }
 
+/**
+ *  Change the ID
+ *  @param  id          the new ID
+ */
+void Query::id(uint16_t id) noexcept
+{
+    // use a local variable to access properties
+    HEADER *header = (HEADER *)_buffer.data();
+    
+    // update the property
+    header->id = htons(id);
+}
+
 /**
  *  The opcode
  *  @return uint8_t
@@ -267,34 +264,36 @@ size_t Query::questions() const
  */
 bool Query::matches(const Response &response) const
 {
-    // prevent exceptions (parsing a record could fail)
-    try
-    {
-        // the ids must match
-        if (response.id() != id()) return false;
-        
-        // in dynamic update packets there is only a header so we cannot check the content
-        if (response.opcode() == ns_o_update && opcode() == ns_o_update) return true;
-        
-        // the query and response must have the same number of questions
-        if (response.questions() != questions()) return false;
-        
-        // we'll be checking all the questions in the question-section of the response
-        // to see if they also appear in the origina query (they should!)
-        for (size_t i = 0; i < response.questions(); ++i)
-        {
-            // get the record from the question-section, and check if the query contains that record
-            if (!contains(Question(response, i))) return false;
-        }
+    // the ids must match
+    if (response.id() != id()) return false;
     
-        // there seems to be a match
-        return true;
-    }
-    catch (...)
+    // and the response must be about our questions
+    return answers(response);
+}
+
+/**
+ *  Is the response about the same questions as this query (the ID is not checked)
+ *  @param  response
+ *  @return bool
+ */
+bool Query::answers(const Response &response) const
+{
+    // in dynamic update packets there is only a header so we cannot check the content
+    if (response.opcode() == ns_o_update && opcode() == ns_o_update) return true;
+    
+    // the query and response must have the same number of questions
+    if (response.questions() != questions()) return false;
+    
+    // we'll be checking all the questions in the question-section of the response
+    // to see if they also appear in the origina query (they should!)
+    for (size_t i = 0; i < response.questions(); ++i)
     {
-        // parse error -- we treat this as a no-match
-        return false;
+        // check if the query contains the question (this is checked on the wire, so it does not throw)
+        if (!contains(response, i)) return false;
     }
+
+    // there seems to be a match
+    return true;
 }
     
 /**
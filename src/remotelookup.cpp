@@ -11,42 +11,93 @@
  *  Dependencies
  */
 #include "remotelookup.h"
+#include "sharedlookup.h"
 #include "../include/dnscpp/core.h"
 #include "../include/dnscpp/response.h"
 #include "../include/dnscpp/answer.h"
 #include "../include/dnscpp/handler.h"
-#include "../include/dnscpp/question.h"
-#include "fakeresponse.h"
+#include <algorithm>
+#include <iterator>
 
 /**
  *  Begin of namespace
  */
 namespace DNS {
 
+/**
+ *  Handler that is used after a lookup was cancelled while other lookups were still
+ *  waiting for its result (the lookup then keeps running, but nobody is notified)
+ *  @var Handler
+ */
+static Handler orphan;
+
 /**
  *  Constructor
  *  @param  core        dns core object
- *  @param  domain      the domain of the lookup
- *  @param  type        the type of the request
- *  @param  bits        bits to include
+ *  @param  query       the query to send
+ *  @param  fingerprint fingerprint of the query
  *  @param  handler     user space object
  */
-RemoteLookup::RemoteLookup(Core *core, const char *domain, ns_type type, const Bits &bits, DNS::Handler *handler) : 
-    Lookup(core, handler, ns_o_query, domain, type, bits), _id(rand()) {}
+RemoteLookup::RemoteLookup(Core *core, const Query &query, const Fingerprint &fingerprint, DNS::Handler *handler) : 
+    Lookup(core, handler, query), _id(rand()), _fingerprint(fingerprint.value()) {}
 
 /**
  *  Destructor
  */
 RemoteLookup::~RemoteLookup()
 {
-    // cleanup the job (note that we have this cleanup-function because we
-    // normally want to cleanup _before_ we report back to userspace, because
-    // you never know what userspace will do (maybe even destruct the _core pointer),
-    // but if userspace decided to kill the job (by calling job->cancel()) we still
-    // have to do some cleaning ourselves
+    // the lookup is normally already cleaned up before it is destructed, but when the 
+    // core is destructed while the lookup is still in progress we still have to 
+    // unsubscribe from the sockets
+    unsubscribe();
+    
+    // we can no longer be shared
+    _core->unshare(_fingerprint, this);
+    
+    // lookups that were still waiting for us are owned by us
+    while (auto *entry = _followers.front()) delete static_cast<Lookup *>(entry);
+}
+
+/**
+ *  Add a lookup for the same query that should get the same result
+ *  @param  lookup      the lookup that is going to wait for us
+ *  @return Operation   the same lookup
+ */
+Operation *RemoteLookup::attach(SharedLookup *lookup)
+{
+    // remember the lookup
+    _followers.push_back(lookup);
+    
+    // expose the lookup
+    return lookup;
+}
+
+/**
+ *  Remove a lookup that was waiting for our result (because it was cancelled)
+ *  @param  lookup      the lookup that no longer waits for us
+ */
+void RemoteLookup::detach(SharedLookup *lookup)
+{
+    // forget the lookup
+    lookup->unlink();
+
+    // if we were cancelled ourselves, we only kept running for the lookups that were waiting for us
+    if (!_followers.empty() || _handler != &orphan) return;
+
+    // nobody is interested in the result anymore, so we stop (the core destructs us later)
     cleanup();
 }
 
+/**
+ *  Pass the result to the lookups that are waiting for it
+ *  @param  response    the response (or nullptr on timeout)
+ */
+void RemoteLookup::release(const Response *response)
+{
+    // hand over the result to all followers (this also removes them from the list)
+    while (auto *entry = _followers.front()) static_cast<SharedLookup *>(entry)->release(response);
+}
+
 /**
  *  Is this lookup still scheduled: meaning that no requests has been sent yet
  *  @return bool
@@ -95,11 +146,15 @@ double RemoteLookup::delay(double now) const
     // if the operation never ran it should also run immediately
     if (_datagrams == 0 || _handler == nullptr) return 0.0;
     
-    // if already doing a tcp lookup, or when all attemps have passed, we wait until the expire-time
-    if (_connections > 0 || _datagrams >= _core->attempts()) return std::max(0.0, _last + _core->timeout() - now);
+    // if already doing a tcp lookup, or when all attemps have passed, we wait until the expire-time,
+    // otherwise we wait until we can send a next datagram
+    double next = _connections > 0 || _datagrams >= _core->attempts() ? _last + _core->timeout() : _last + _interval;
+    
+    // a hedged datagram might have to be sent before that
+    if (_hedge > 0.0) next = std::min(next, _hedge);
     
-    // wait until we can send a next datagram
-    return std::max(_last + _core->interval() - now, 0.0);
+    // wait until then
+    return std::max(next - now, 0.0);
 }
 
 /**
@@ -120,8 +175,8 @@ void RemoteLookup::unsubscribe()
     // unsubscribe from the UDP sockets
     for (const auto &subscription : _subscriptions)
     {
-        // this is a pair
-        subscription.first->unsubscribe(this, subscription.second, _query.id());
+        // this is a tuple
+        std::get<0>(subscription)->unsubscribe(this, std::get<1>(subscription), std::get<2>(subscription));
     }
 
     // we have no subscriptions left
@@ -144,17 +199,165 @@ Handler *RemoteLookup::cleanup()
     
     // unsubscribe from all inbound sockets
     unsubscribe();
+    
+    // new queries can no longer share this lookup
+    _core->unshare(_fingerprint, this);
+    
+    // the core no longer has to keep track of this lookup
+    _core->done(this);
 
     // expose the handler
     return handler;
 }
 
+/**
+ *  Number of datagrams that were sent to a certain nameserver
+ *  @param  ip          address of the nameserver
+ *  @return size_t
+ */
+size_t RemoteLookup::sent(const Ip &ip) const
+{
+    // count the datagrams
+    return std::count_if(_sent.begin(), _sent.end(), [&ip](const std::pair<Ip,double> &sent) { return sent.first == ip; });
+}
+
+/**
+ *  Select the nameserver to which the next datagram is sent: this is the server
+ *  to which we sent the fewest datagrams, and of those the one with the lowest
+ *  expected cost (based on its round trip time and recent timeouts)
+ *  @param  now         current time
+ *  @return size_t      index of the nameserver
+ */
+size_t RemoteLookup::select(double now) const
+{
+    // access to the nameservers + the number we have
+    auto &nameservers = _core->nameservers();
+    size_t nscount = nameservers.size();
+    
+    // the best server so far
+    size_t best = 0, bestsent = SIZE_MAX; double bestcost = 0.0;
+    
+    // check all servers
+    for (size_t i = 0; i < nscount; ++i)
+    {
+        // if servers are rotated, each lookup starts at a different server (this matters for equal costs)
+        size_t index = _core->rotate() ? (i + _id) % nscount : i;
+        
+        // the server to check
+        auto &nameserver = nameservers[index];
+        
+        // number of datagrams that we already sent to it, and its expected cost
+        size_t datagrams = sent(nameserver);
+        double cost = nameserver.cost(now, _core->interval());
+        
+        // skip if this server is not better
+        if (datagrams > bestsent || (datagrams == bestsent && cost >= bestcost)) continue;
+        
+        // this is the best server so far
+        best = index; bestsent = datagrams; bestcost = cost;
+    }
+    
+    // expose the best server
+    return best;
+}
+
+/**
+ *  Compute the time to wait for a response from a nameserver before the next datagram is sent
+ *  @param  nameserver  the nameserver to which the last datagram was sent
+ *  @return double
+ */
+double RemoteLookup::interval(const Nameserver &nameserver) const
+{
+    // if not adaptive, or when we know nothing about the server, we use the configured interval
+    if (!_core->adaptive() || nameserver.samples() == 0) return _core->interval();
+    
+    // the retransmission timeout of the server, doubled for every next attempt
+    double rto = std::ldexp(nameserver.rto(), (int)std::min(_datagrams, size_t(16)) - 1);
+    
+    // the configured intervals are the limits
+    return std::min(std::max(rto, _core->mininterval()), _core->interval());
+}
+
+/**
+ *  Update the statistics of the nameserver from which a response was received
+ *  @param  ip          address of the nameserver
+ *  @param  now         current time
+ */
+void RemoteLookup::measure(const Ip &ip, double now)
+{
+    // find the nameserver (it might have been removed in the meantime)
+    auto *nameserver = _core->find(ip);
+    if (nameserver == nullptr) return;
+    
+    // if we sent more than one datagram to this server, we do not know to which one the
+    // response belongs, so we can not use the round trip time (Karn's algorithm)
+    if (sent(ip) != 1) return nameserver->success(now, -1.0);
+    
+    // find the time when the datagram was sent
+    for (const auto &datagram : _sent) if (datagram.first == ip) return nameserver->success(now, now - datagram.second);
+}
+
+/**
+ *  Send a datagram to a nameserver
+ *  @param  nameserver  the nameserver to send it to
+ *  @param  now         current time
+ */
+void RemoteLookup::send(const Nameserver &nameserver, double now)
+{
+    // the ID with which the datagram is sent (the sockets pick one that is not yet in use)
+    uint16_t id = 0;
+
+    // send a datagram to this server
+    auto *inbound = _core->datagram(nameserver, _query, id);
+
+    // remember when it was sent
+    _sent.emplace_back(nameserver, now);
+    
+    // if the datagram was not _really_ sent (unlikely), we will treat it just as if it WAS sent,
+    // so that the problem will be picked up when the timer expires
+    if (inbound == nullptr) return;
+    
+    // subscribe to the answers that might come in from now onwards (they get the ID of our query back)
+    inbound->subscribe(this, nameserver, id, _query.id());
+    
+    // store this subscription, so that we can unsubscribe on success
+    _subscriptions.emplace(inbound, nameserver, id);
+}
+
+/**
+ *  Penalize the nameservers that did not respond since the last regular datagram was sent
+ *  (this is the server to which that datagram was sent, plus the server of a hedged datagram)
+ *  @param  now         current time
+ */
+void RemoteLookup::penalize(double now)
+{
+    // check the datagrams in reverse order
+    for (auto iter = _sent.rbegin(); iter != _sent.rend() && iter->second >= _last; ++iter)
+    {
+        // servers that refused the datagram were already penalized
+        if (std::find(_refused.begin(), _refused.end(), iter->first) != _refused.end()) continue;
+        
+        // find the nameserver (it might have been removed in the meantime)
+        if (auto *nameserver = _core->find(iter->first)) nameserver->failure(now);
+    }
+    
+    // the next datagrams start with a clean slate
+    _refused.clear();
+}
+
 /** 
  *  Time out the job because no appropriate response was received in time
  *  @return bool        wsa there a call to userspace?
  */
 bool RemoteLookup::timeout()
 {
+    // the servers to which the last datagrams were sent did not respond (if tcp was used because of 
+    // a truncated response, the server did respond, but the tcp connection is too slow)
+    if (_connections == 0 || !_truncated) penalize(Now());
+    
+    // the lookups that are waiting for us time out too
+    release(nullptr);
+    
     // before we report to userspace we cleanup the object
     cleanup()->onTimeout(this);
     
@@ -173,6 +376,19 @@ bool RemoteLookup::execute(double now)
     // when job times out
     if ((_connections > 0 || _datagrams >= _core->attempts()) && now > _last + _core->timeout()) return timeout();
 
+    // if it is time for a hedged datagram, we send it to the next best server (this is not counted as an attempt)
+    if (_hedge > 0.0 && now >= _hedge)
+    {
+        // this is done only once
+        _hedge = 0.0;
+        
+        // send it if we are not already using tcp, and if the budget allows it
+        if (_connections == 0 && !_core->nameservers().empty() && _core->spend()) send(_core->nameservers()[select(now)], now);
+    }
+    
+    // the hedged datagram might have been sent before the next regular datagram is due
+    if (_datagrams > 0 && now < _last + _interval) return false;
+
     // if we reached the max attempts we stop sending out more datagrams
     if (_datagrams >= _core->attempts()) return false;
 
@@ -186,27 +402,57 @@ bool RemoteLookup::execute(double now)
     // what if there are no nameservers?
     if (nscount == 0) return timeout();
 
+    // the servers to which the previous datagrams were sent did not respond in time
+    if (!_sent.empty()) penalize(now);
+
     // which nameserver should we sent now?
-    size_t target = _core->rotate() ? (_datagrams + _id) % nscount : _datagrams % nscount;
-    
-    // send a datagram to each nameserver
-    auto &nameserver = nameservers[target];
+    auto &nameserver = nameservers[select(now)];
+
+    // with a tcp transport policy the query is sent over a (pooled) connection, it is not repeated 
+    // after an interval but only when the connection fails (see abandon()), this also happens when 
+    // the server recently truncated the response to the same question (so that we save a round trip)
+    bool stream = _core->stream(nameserver), truncated = !stream && _core->truncated(nameserver, _fingerprint, now);
+
+    // if we use tcp, we need a connection
+    if ((stream || truncated) && connect(nameserver))
+    {
+        // if we use tcp because of an earlier truncated response, a round trip was saved
+        if (truncated) _core->saved();
+
+        // remember why we use tcp (if the connection fails we fall back to a datagram)
+        _remembered = truncated;
+
+        // remember where it was sent, so that an other server is selected for a next attempt
+        _sent.emplace_back(nameserver, now);
+
+        // one more attempt was made, over tcp
+        _datagrams += 1; _last = now; _connections = 1;
+
+        // no call to user space
+        return false;
+    }
 
     // send a datagram to this server
-    auto *inbound = _core->datagram(nameserver, _query);
+    send(nameserver, now);
 
     // one more message has been sent
     _datagrams += 1; _last = now;
     
-    // if the datagram was not _really_ sent (unlikely), we will treat it just as if it WAS sent,
-    // so that the problem will be picked up when the timer expires
-    if (inbound == nullptr) return false;
-    
-    // subscribe to the answers that might come in from now onwards
-    inbound->subscribe(this, nameserver, _query.id());
+    // the time to wait before the next datagram is sent
+    _interval = interval(nameserver);
     
-    // store this subscription, so that we can unsubscribe on success
-    _subscriptions.emplace(std::make_pair(inbound, nameserver));
+    // after the first datagram we might send a hedged datagram to a second server
+    if (_datagrams == 1 && _core->hedging() > 0.0 && nscount > 1)
+    {
+        // every lookup adds a little to the budget for hedged datagrams
+        _core->earn();
+        
+        // the time after which the first server is slower than it normally is (unknown if we have too few samples)
+        double threshold = nameserver.percentile(_core->hedging());
+        
+        // this is only useful if it is before the next regular datagram
+        if (threshold >= 0.0 && threshold < _interval) _hedge = now + threshold;
+    }
 
     // no call to user space
     return false;
@@ -224,25 +470,14 @@ bool RemoteLookup::report(const Response &response)
     // if the result has already been reported, we do nothing here
     if (_handler == nullptr) return false;
     
-    // for NXDOMAIN errors we need special treatment (maybe the hostname _does_ exists in 
-    // /etc/hosts?) For all other type of results the message can be passed to userspace
-    if (response.rcode() != ns_r_nxdomain) return cleanup()->onReceived(this, response), true;
-
-    // extract the original question, to find out the host for which we were looking
-    Question question(response);
-    
-    // there was a NXDOMAIN error, which we should not communicate if our /etc/hosts
-    // file does have a record for this hostname, check this
-    if (!_core->exists(question.name())) return cleanup()->onReceived(this, response), true;
+    // store the response in the cache, so that future queries can be answered right away
+    _core->remember(_query, response);
     
-    // get the original request (so that the response can match the request)
-    Request request(this);
+    // the lookups that are waiting for us get the same response
+    release(&response);
     
-    // construct a fake-response message (it is fake because we have not actually received it)
-    FakeResponse fake(request, question);
-
-    // send the fake-response to user-space
-    cleanup()->onReceived(this, Response(fake.data(), fake.size()));
+    // pass the response to userspace (this also deals with /etc/hosts)
+    deliver(cleanup(), response);
     
     // done
     return true;
@@ -256,22 +491,32 @@ bool RemoteLookup::report(const Response &response)
  */
 bool RemoteLookup::onReceived(const Ip &ip, const Response &response)
 {
-    // ignore responses that do not match with the query
+    // ignore responses that do not match with the query (the ID is not checked here, because the 
+    // sockets already dispatch on the ID with which the query was sent, and restore the ID of our query)
     // @todo should we check for more? like whether the response is indeed a response
-    if (!_query.matches(response)) return false;
+    if (!_query.answers(response)) return false;
+    
+    // the round trip time of the nameserver can be updated (but not for tcp, because that is not comparable)
+    if (_connections == 0) measure(ip, Now());
+
+    // when we chose tcp ourselves we still know that the server is working
+    else if (auto *nameserver = _truncated ? nullptr : _core->find(ip)) nameserver->success(Now(), -1.0);
     
     // if the response was not truncated, we can report it to userspace, we do this also
     // when the response came from a TCP lookup and was still truncated
     if (!response.truncated() || _connections > 0) return report(response);
 
+    // the server might be used over tcp right away in the future (depending on the transport policy)
+    if (auto *nameserver = _core->find(ip)) nameserver->truncated();
+
+    // a next lookup for this question will certainly be truncated too
+    _core->truncated(ip, _fingerprint);
+
     // we can unsubscribe from all inbound udp sockets because we're no longer interested in those responses
     unsubscribe();
     
     // try to connect to a TCP socket
-    _connecting = _core->connect(ip, this);
-    
-    // on failure we report the original truncated response
-    if (_connecting == nullptr) return report(response);
+    if (!connect(ip)) return report(response);
 
     // this was the very first time that we set up a tcp connection
     _connections = 1;
@@ -290,6 +535,82 @@ bool RemoteLookup::onReceived(const Ip &ip, const Response &response)
     return false;
 }
 
+/**
+ *  Set up a tcp connection to a nameserver, an established connection is used right away
+ *  @param  ip          the nameserver
+ *  @return bool        false if no connection could be set up
+ */
+bool RemoteLookup::connect(const Ip &ip)
+{
+    // is there already a connection (that was kept open after an earlier lookup)?
+    auto *tcp = _core->established(ip);
+
+    // the query is sent over it right away (if that fails we set up a new connection)
+    if (tcp != nullptr && send(ip, tcp)) return true;
+
+    // otherwise we subscribe to a connection that is being set up
+    _connecting = _core->connect(ip, this);
+
+    // report whether this worked
+    return _connecting != nullptr;
+}
+
+/**
+ *  Give up on tcp after the connection to a nameserver failed
+ *  @param  ip          the nameserver
+ *  @return bool        was there a call to userspace?
+ */
+bool RemoteLookup::abandon(const Ip &ip)
+{
+    // if tcp was used because of a truncated response, we report that response
+    if (_truncated) return report(*_truncated);
+
+    // we no longer use tcp
+    _connections = 0;
+
+    // if tcp was used because the server recently truncated the same question, the server itself is not
+    // to blame, we send it a datagram after all (and no longer go to tcp for this question right away)
+    auto *nameserver = _remembered ? _core->find(ip) : nullptr;
+    if (nameserver != nullptr)
+    {
+        // this is done only once
+        _remembered = false;
+
+        // forget about the earlier truncated response
+        _core->untruncated(ip, _fingerprint);
+
+        // the datagram replaces the tcp attempt (so it is not counted as an extra attempt)
+        if (!_sent.empty() && _sent.back().first == ip) _sent.pop_back();
+
+        // send the datagram
+        double now = Now();
+        send(*nameserver, now);
+
+        // wait for the response to it
+        _last = now; _interval = interval(*nameserver);
+
+        // let the core know when we want to run again
+        _core->expedite(this);
+
+        // no call to userspace
+        return false;
+    }
+
+    // the tcp transport policy made us use tcp, so the server is not working well (we remember that it 
+    // was already penalized, just like when it refuses datagrams)
+    if (auto *nameserver = _core->find(ip)) nameserver->failure(Now());
+    _refused.push_back(ip);
+
+    // the next attempt can be made right away (if there are attempts left)
+    _interval = 0.0;
+
+    // let the core run us soon
+    _core->expedite(this);
+
+    // no call to userspace
+    return false;
+}
+
 /**
  *  Called when a TCP connection was lost in the middle of an operation
  *  @param  ip          ip to which the connection was set up
@@ -297,16 +618,19 @@ bool RemoteLookup::onReceived(const Ip &ip, const Response &response)
  */
 bool RemoteLookup::onLost(const Ip &ip)
 {
+    // the connection already dropped our subscription and may soon be destructed, so we forget about it
+    for (auto iter = _subscriptions.begin(); iter != _subscriptions.end(); ) iter = std::get<0>(*iter) == _stream ? _subscriptions.erase(iter) : std::next(iter);
+    
+    // we are no longer using it
+    _stream = nullptr;
+
     // this is a hardcoded limit to avoid loops of tcp connect attempts
     // @todo maybe make this a configurable parameter?
-    if (_connections > 10) return report(*_truncated);
+    if (_connections > 10) return abandon(ip);
     
     // connection was lost in the middle of an operation, we try to connect _again_
     // @todo maybe try a different nameserver now?
-    _connecting = _core->connect(ip, this);
-    
-    // if it still failed, we report the truncated response (the reason why we tried tcp in the first place)
-    if (_connecting == nullptr) return report(*_truncated);
+    if (!connect(ip)) return abandon(ip);
 
     // one extra tcp connection is in progress
     _connections += 1;
@@ -315,6 +639,39 @@ bool RemoteLookup::onLost(const Ip &ip)
     return false;
 }
 
+/**
+ *  Called when a nameserver turned out to be unreachable (connected udp sockets only)
+ *  @param  ip          ip of the nameserver
+ *  @return bool        was there a call to userspace?
+ */
+bool RemoteLookup::onUnreachable(const Ip &ip)
+{
+    // ignore if the lookup is already finished, or when we moved on to tcp
+    if (_handler == nullptr || _connections > 0) return false;
+    
+    // we only care if the server was refused for the first time, and if it got one of the datagrams that were not yet penalized
+    auto refused = [this](const Ip &server) { return std::find(_refused.begin(), _refused.end(), server) != _refused.end(); };
+    auto recent = [&ip, this](const std::pair<Ip,double> &datagram) { return datagram.first == ip && datagram.second >= _last; };
+    if (refused(ip) || std::none_of(_sent.begin(), _sent.end(), recent)) return false;
+    
+    // the nameserver is marked as failed right away (and not again when the lookup proceeds)
+    if (auto *nameserver = _core->find(ip)) nameserver->failure(Now());
+    _refused.push_back(ip);
+    
+    // if an other server might still respond (to a hedged datagram, for example) it gets the normal time to do so
+    auto pending = [&refused, this](const std::pair<Ip,double> &datagram) { return datagram.second >= _last && !refused(datagram.first); };
+    if (std::any_of(_sent.begin(), _sent.end(), pending)) return false;
+    
+    // there is no reason to wait for the regular datagram, the next one can be sent right away
+    _interval = 0.0;
+    
+    // let the core run us soon
+    _core->expedite(this);
+    
+    // no call to userspace
+    return false;
+}
+
 /**
  *  Called when a TCP connection has been set up (in case an earlier UDP response was truncated)
  *  @param  ip          ip to which a connection was set up
@@ -326,20 +683,41 @@ bool RemoteLookup::onConnected(const Ip &ip, Tcp *tcp)
     // forget that we are connecting
     _connecting = nullptr;
     
+    // send the query, if we failed to send it means that the connection was lost in the meantime
+    if (!send(ip, tcp)) return onLost(ip);
+
+    // no call to userspace yet
+    return false;
+}
+
+/**
+ *  Send the query over a tcp connection
+ *  @param  ip          ip to which the connection was set up
+ *  @param  tcp         the actual TCP connection
+ *  @return bool        false if the connection was already lost
+ */
+bool RemoteLookup::send(const Ip &ip, Tcp *tcp)
+{
+    // the connection picks its own ID for the query, so that it does not wait for other lookups with the same ID
+    uint16_t id = 0;
+
     // send the query (this can fail when the connection was immediately lost)
-    auto *inbound = tcp->send(_query);
+    auto *inbound = tcp->send(_query, id);
     
     // if we failed to send it means that the connection was lost in the meantime
-    if (inbound == nullptr) return onLost(ip);
+    if (inbound == nullptr) return false;
 
-    // subscribe to the answers that might come in from now onwards
-    inbound->subscribe(this, ip, _query.id());
+    // subscribe to the answers that might come in from now onwards (they get the ID of our query back)
+    inbound->subscribe(this, ip, id, _query.id());
         
     // store this subscription, so that we can unsubscribe on success
-    _subscriptions.emplace(std::make_pair(inbound, ip));
+    _subscriptions.emplace(inbound, ip, id);
+
+    // remember the connection, in case it is lost
+    _stream = inbound;
     
-    // no call to userspace yet
-    return false;
+    // the query is on its way
+    return true;
 }
 
 /**
@@ -354,7 +732,7 @@ bool RemoteLookup::onFailure(const Ip &ip)
 
     // tcp failed, in this case we want to send the truncated response instead
     // @todo maybe try a different nameserver now?
-    return report(*_truncated);
+    return abandon(ip);
 }
 
 /**
@@ -365,13 +743,22 @@ void RemoteLookup::cancel()
     // do nothing if already cancelled
     if (_handler == nullptr) return;
     
-    // notify the core so that it can schedule more lookups
-    // NOTE that this is not so elegant, as it is not the responsibility of the Lookup class 
-    // to keep the bookkeeping of the Core class correct
-    _core->cancel(this);
+    // if other lookups are waiting for our result we keep running (until they are cancelled too, see detach()),
+    // but we no longer report to this handler
+    if (!_followers.empty())
+    {
+        // remember the handler
+        auto *handler = _handler;
+        
+        // from now on, the result is reported to nobody
+        _handler = &orphan;
+        
+        // report to userspace
+        return handler->onCancelled(this);
+    }
     
-    // cleanup, and report to userspace
-    cleanup()->onCancelled(this);
+    // cleanup, and let the core report to userspace (this also destructs `this`)
+    _core->cancel(this, cleanup());
 }
 
 /**
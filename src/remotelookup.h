@@ -17,6 +17,8 @@
  */
 #include <memory>
 #include <set>
+#include <tuple>
+#include <vector>
 #include "../include/dnscpp/timer.h"
 #include "../include/dnscpp/query.h"
 #include "../include/dnscpp/lookup.h"
@@ -24,9 +26,12 @@
 #include "../include/dnscpp/bits.h"
 #include "../include/dnscpp/now.h"
 #include "../include/dnscpp/ip.h"
+#include "../include/dnscpp/nameserver.h"
 #include "../include/dnscpp/processor.h"
 #include "../include/dnscpp/connecting.h"
+#include "../include/dnscpp/wheel.h"
 #include "connector.h"
+#include "fingerprint.h"
 
 /**
  *  Begin of namespace
@@ -39,6 +44,7 @@ namespace DNS {
 class Core;
 class Handler;
 class Inbound;
+class SharedLookup;
 
 /**
  *  Class definition
@@ -52,6 +58,18 @@ private:
      */
     double _last = 0.0;
     
+    /**
+     *  The time to wait after the last datagram before the next one is sent
+     *  @var double
+     */
+    double _interval = 0.0;
+    
+    /**
+     *  Time at which a hedged datagram is sent to a second nameserver (zero if not needed)
+     *  @var double
+     */
+    double _hedge = 0.0;
+    
     /**
      *  Number of datagram messages that have already been sent
      *  @var size_t
@@ -76,12 +94,38 @@ private:
      *  @var std::unique_ptr<Response>
      */
     std::unique_ptr<Response> _truncated;
+
+    /**
+     *  Did we use tcp right away because the nameserver recently truncated the response to the same question?
+     *  @var bool
+     */
+    bool _remembered = false;
     
     /**
-     *  Objects to which we're subscribed for inbound messages
+     *  The nameservers to which datagrams were sent, and the time when they were sent
+     *  @var std::vector
+     */
+    std::vector<std::pair<Ip,double>> _sent;
+
+    /**
+     *  Nameservers that refused a datagram since the last regular datagram was sent (these were
+     *  already penalized when that happened, so they should not be penalized again)
+     *  @var std::vector
+     */
+    std::vector<Ip> _refused;
+    
+    /**
+     *  Objects to which we're subscribed for inbound messages (and the address and ID of the subscription)
      *  @var std::set
      */
-    std::set<std::pair<Inbound*,Ip>> _subscriptions;
+    std::set<std::tuple<Inbound*,Ip,uint16_t>> _subscriptions;
+
+    /**
+     *  The tcp connection over which the query was sent (the connection drops our subscription
+     *  itself when it is lost, so we then have to forget about it too)
+     *  @var Inbound
+     */
+    Inbound *_stream = nullptr;
 
     /**
      *  During the short period in which we're busy doing a TCP lookup, we keep a pointer
@@ -90,6 +134,18 @@ private:
      */
     Connecting *_connecting = nullptr;
 
+    /**
+     *  Fingerprint of the query (empty if the lookup can not be shared)
+     *  @var std::string
+     */
+    std::string _fingerprint;
+
+    /**
+     *  Lookups for the same query that are waiting for our result
+     *  @var Wheel::List
+     */
+    Wheel::List _followers;
+
 
     /**
      *  Method that is called when a dgram response is received
@@ -106,6 +162,13 @@ private:
      */
     virtual bool onLost(const Ip &ip) override;
 
+    /**
+     *  Called when a nameserver turned out to be unreachable (its port is closed)
+     *  @param  ip          ip of the nameserver
+     *  @return bool        was there a call to userspace?
+     */
+    virtual bool onUnreachable(const Ip &ip) override;
+
     /**
      *  Called when a TCP connection has been set up (in case an earlier UDP response was truncated)
      *  @param  ip          ip to which a connection was set up
@@ -156,6 +219,69 @@ private:
      */
     virtual double delay(double now) const override;
 
+    /**
+     *  Number of datagrams that were sent to a certain nameserver
+     *  @param  ip      address of the nameserver
+     *  @return size_t
+     */
+    size_t sent(const Ip &ip) const;
+
+    /**
+     *  Select the nameserver to which the next datagram is sent
+     *  @param  now     current time
+     *  @return size_t  index of the nameserver
+     */
+    size_t select(double now) const;
+
+    /**
+     *  Compute the time to wait for a response from a nameserver before the next datagram is sent
+     *  @param  nameserver  the nameserver to which the last datagram was sent
+     *  @return double
+     */
+    double interval(const Nameserver &nameserver) const;
+
+    /**
+     *  Send a datagram to a nameserver
+     *  @param  nameserver  the nameserver to send it to
+     *  @param  now         current time
+     */
+    void send(const Nameserver &nameserver, double now);
+
+    /**
+     *  Send the query over a tcp connection
+     *  @param  ip          ip to which the connection was set up
+     *  @param  tcp         the actual TCP connection
+     *  @return bool        false if the connection was already lost
+     */
+    bool send(const Ip &ip, Tcp *tcp);
+
+    /**
+     *  Set up a tcp connection to a nameserver, an established connection is used right away
+     *  @param  ip          the nameserver
+     *  @return bool        false if no connection could be set up
+     */
+    bool connect(const Ip &ip);
+
+    /**
+     *  Give up on tcp after the connection to a nameserver failed
+     *  @param  ip          the nameserver
+     *  @return bool        was there a call to userspace?
+     */
+    bool abandon(const Ip &ip);
+
+    /**
+     *  Penalize the nameservers that did not respond since the last regular datagram was sent
+     *  @param  now         current time
+     */
+    void penalize(double now);
+
+    /**
+     *  Update the statistics of the nameserver from which a response was received
+     *  @param  ip      address of the nameserver
+     *  @param  now     current time
+     */
+    void measure(const Ip &ip, double now);
+
     /**
      *  Retry / send a new message to the nameservers
      *  @param  now     current time
@@ -169,6 +295,12 @@ private:
      */
     bool report(const Response &response);
 
+    /**
+     *  Pass the result to the lookups that are waiting for it
+     *  @param  response    the response (or nullptr on timeout)
+     */
+    void release(const Response *response);
+
     /**
      *  Cleanup the object
      *  @return Handler
@@ -208,12 +340,11 @@ public:
     /**
      *  Constructor
      *  @param  core        dns core object
-     *  @param  domain      the domain of the lookup
-     *  @param  type        type of records to look for
-     *  @param  bits        the bits to include in the request
+     *  @param  query       the query to send
+     *  @param  fingerprint fingerprint of the query
      *  @param  handler     user space object interested in the result
      */
-    RemoteLookup(Core *core, const char *domain, ns_type type, const Bits &bits, DNS::Handler *handler);
+    RemoteLookup(Core *core, const Query &query, const Fingerprint &fingerprint, DNS::Handler *handler);
     
     /**
      *  No copying
@@ -225,6 +356,19 @@ public:
      *  Destructor
      */
     virtual ~RemoteLookup();
+
+    /**
+     *  Add a lookup for the same query that should get the same result
+     *  @param  lookup      the lookup that is going to wait for us
+     *  @return Operation   the same lookup
+     */
+    Operation *attach(SharedLookup *lookup);
+
+    /**
+     *  Remove a lookup that was waiting for our result (because it was cancelled)
+     *  @param  lookup      the lookup that no longer waits for us
+     */
+    void detach(SharedLookup *lookup);
 };
 
 /**
@@ -0,0 +1,199 @@
+/**
+ *  SharedLookup.h
+ *
+ *  Class that implements a lookup that shares the query of an identical 
+ *  remote lookup that was already in progress. No datagrams are sent for
+ *  this lookup: it waits for the remote lookup to finish, and then reports
+ *  the same result (with its own ID) in a later tick of the event loop.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/lookup.h"
+#include "../include/dnscpp/response.h"
+#include "../include/dnscpp/handler.h"
+#include "../include/dnscpp/core.h"
+#include "remotelookup.h"
+#include <vector>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class SharedLookup : public Lookup
+{
+private:
+    /**
+     *  The response of the remote lookup (empty if it timed out)
+     *  @var std::vector
+     */
+    std::vector<unsigned char> _response;
+
+    /**
+     *  Has the remote lookup finished? Before that, this lookup is stored in
+     *  the list of the remote lookup, and not in the wheel of the core
+     *  @var bool
+     */
+    bool _released = false;
+
+    /**
+     *  The remote lookup for which we wait (only valid as long as we are not released)
+     *  @var RemoteLookup
+     */
+    RemoteLookup *_leader;
+
+    /**
+     *  Execute the lookup. Returns true when a user-space call was made, and false when further
+     *  processing is required.
+     *  @param  now         current time
+     *  @return bool        was there a call back to userspace?
+     */
+    virtual bool execute(double now) override
+    {
+        // do nothing if ready
+        assert(!finished() && _released);
+
+        // remember the handler
+        auto *handler = _handler;
+
+        // get rid of the handler to avoid that the result is reported
+        _handler = nullptr;
+
+        // the core no longer has to keep track of this lookup
+        _core->done(this);
+
+        // if the remote lookup did not get a response, this lookup timed out too
+        if (_response.empty())
+        {
+            // report the timeout
+            handler->onTimeout(this);
+
+            // a call to userspace was made
+            return true;
+        }
+
+        // pass the response to userspace
+        deliver(handler, Response(_response.data(), _response.size()));
+
+        // done
+        return true;
+    }
+
+    /**
+     *  How long should we wait until the next runtime?
+     *  @param  now         current time
+     *  @return double      delay in seconds
+     */
+    virtual double delay(double now) const override
+    {
+        // should run right away (we are only in the wheel when the result is known)
+        return 0.0;
+    }
+
+    /**
+     *  Is this lookup still scheduled: meaning that no requests have been sent yet
+     *  @return bool
+     */
+    virtual bool scheduled() const override
+    {
+        // the remote lookup sends the requests, so we act as if they were sent
+        return false;
+    }
+
+    /**
+     *  Is this lookup already finished: meaning that a result has been reported back to userspace
+     *  @return bool
+     */
+    virtual bool finished() const override
+    {
+        // handler is reset on completion
+        return _handler == nullptr;
+    }
+
+    /**
+     *  Is this lookup exhausted: meaning that it has sent its max number of requests, but still
+     *  has not received an appropriate answer, and is now waiting for its final timer to finish
+     *  @return bool
+     */
+    virtual bool exhausted() const override
+    {
+        // we never send out requests ourselves
+        return true;
+    }
+
+    /**
+     *  Cancel the operation
+     */
+    virtual void cancel() override
+    {
+        // if already reported back to user-space
+        if (_handler == nullptr) return;
+
+        // remember the handler
+        auto *handler = _handler;
+
+        // get rid of the handler to avoid that the result is reported
+        _handler = nullptr;
+
+        // when we are still waiting for the remote lookup, we only have to leave its list (the 
+        // core does not know about us yet), otherwise the core no longer has to keep track of us
+        if (_released) _core->done(this); else _leader->detach(this);
+
+        // the last instruction is to report it back to user-space (this also destructs `this`)
+        _core->cancel(this, handler);
+    }
+
+public:
+    /**
+     *  Constructor
+     *  @param  core        the core object
+     *  @param  leader      the remote lookup for which we wait
+     *  @param  query       the query (it is not sent, but it is exposed to user space)
+     *  @param  handler     user space handler
+     */
+    SharedLookup(Core *core, RemoteLookup *leader, const Query &query, Handler *handler) :
+        Lookup(core, handler, query), _leader(leader) {}
+
+    /**
+     *  Destructor
+     */
+    virtual ~SharedLookup() = default;
+
+    /**
+     *  Called by the remote lookup when it has finished, after which the result is 
+     *  reported to user space in the next iteration of the event loop
+     *  @param  response    the response (or nullptr when the remote lookup timed out)
+     */
+    void release(const Response *response)
+    {
+        // remember the response
+        if (response != nullptr) _response.assign(response->data(), response->end());
+
+        // the response should have the ID of our own query
+        if (!_response.empty()) memcpy(_response.data(), _query.data(), 2);
+
+        // we are no longer waiting
+        _released = true;
+
+        // hand over to the core (this also removes us from the list of the remote lookup)
+        _core->resume(this);
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -23,22 +23,16 @@ namespace DNS {
 /**
  *  Add a message for delayed processing
  *  @param  addr    the address from which the message was received
- *  @param  buffer  the response buffer
+ *  @param  data    the response data
+ *  @param  size    size of the data
  */
-void Socket::add(const sockaddr *addr, std::vector<unsigned char> &&buffer)
+void Socket::add(const sockaddr *addr, const unsigned char *data, size_t size)
 {
-    // avoid exceptions (in case the ip cannot be parsed)
-    try
-    {
-        // @todo inbound messages that do not come from port 53 can be ignored
+    // ignore datagrams that nobody is waiting for (before anything is allocated)
+    if (!expected(addr, data, size)) { _dropped += 1; return; }
 
-        // remember the response for now
-        _responses.emplace_back(addr, move(buffer));
-    }
-    catch (...)
-    {
-        // ip address could not be parsed
-    }
+    // remember the response (it is copied into a buffer that is recycled)
+    _inbox.add(Ip(addr), data, size);
 
     // reschedule the processing of messages
     _handler->onActive(this);
@@ -49,10 +43,10 @@ void Socket::add(const sockaddr *addr, std::vector<unsigned char> &&buffer)
  *  @param  addr    the address from which the message was received
  *  @param  buffer  the response buffer
  */
-void Socket::add(const Ip &addr, std::vector<unsigned char> &&buffer)
+void Socket::add(const Ip &addr, std::vector<unsigned char> &buffer)
 {
-    // add to the list
-    _responses.emplace_back(addr, move(buffer));
+    // add to the inbox
+    _inbox.add(addr, buffer);
 
     // reschedule the processing of messages
     _handler->onActive(this);
@@ -73,48 +67,53 @@ size_t Socket::process(size_t maxcalls)
     Watcher watcher(this);
 
     // look for a response
-    while (result < maxcalls && watcher.valid() && !_responses.empty())
+    while (result < maxcalls && watcher.valid() && !_inbox.empty())
     {
-        // avoid exceptions (parsing the response could fail)
-        try
-        {
-            // note that the _handler->onReceived() triggers a call to user-space that might destruct 'this',
-            // which also causes responses to be destructed. To avoid silly crashes we copy the oldest message
-            // to the local stack in a one-item-big list
-            decltype(_responses) oneitem;
+        // note that the _handler->onReceived() triggers a call to user-space that might destruct 'this',
+        // which also causes the inbox to be destructed. To avoid silly crashes the oldest message is
+        // moved to a buffer on the stack (the buffers are swapped, so this does not allocate)
+        std::vector<unsigned char> buffer;
+        buffer.swap(_spare);
+
+        // the address from which the message came
+        Ip ip;
 
-            // move the first item from the responses to the one-item list
-            oneitem.splice(oneitem.begin(), _responses, _responses.begin(), std::next(_responses.begin()));
+        // take the oldest message
+        _inbox.pop(ip, buffer);
 
-            // get the first element
-            const auto &front = oneitem.front();
+        // messages without a full header are certainly malformed
+        if (buffer.size() < HFIXEDSZ) { buffer.swap(_spare); continue; }
 
-            // parse the response
-            Response response(front.second.data(), front.second.size());
+        // the ID with which the query was sent, and the ID of the original query
+        uint16_t id = ns_get16(buffer.data()), original = id;
 
-            // make it known that this ID is now free to use
-            onReceivedId(response.id());
+        // find the processor that is waiting for this response
+        auto *processor = _processors.find(ip, id, original);
 
-            // filter on the response, the beginning is simply the handler at nullptr
-            auto begin = _processors.lower_bound(std::make_tuple(response.id(), front.first, nullptr));
+        // the query might have been sent with a different ID than the original query, the 
+        // response gets the original ID back, so that user space sees the ID of its own query
+        if (processor != nullptr) ns_put16(original, buffer.data());
 
-            // iterate over those elements, notifying each handler
-            for (auto iter = begin; iter != _processors.end(); ++iter)
-            {
-                // if this element is not applicable any more, we're going to leap out (we're done)
-                if (std::get<0>(*iter) != response.id() || std::get<1>(*iter) != front.first) break;
+        // parse the response (this does not throw, because malformed messages are common under attack)
+        Response response;
+        if (!response.parse(buffer.data(), buffer.size())) { buffer.swap(_spare); continue; }
 
-                // call the onreceived for the element
-                if (std::get<2>(*iter)->onReceived(front.first, response)) result += 1;
+        // make it known that this ID is now free to use
+        onReceived(id, response);
 
-                // the message was processed, we no longer need other handlers
-                break;
-            }
+        // avoid exceptions (in case the callback handler throws)
+        try
+        {
+            // notify the handler (the message was processed, other handlers are not needed)
+            if (processor != nullptr && processor->onReceived(ip, response)) result += 1;
         }
         catch (const std::runtime_error &error)
         {
-            // parsing the response failed, or the callback handler threw an exception
+            // the callback handler threw an exception
         }
+
+        // if the socket still exists, the buffer can be used again
+        if (watcher.valid()) buffer.swap(_spare);
     }
 
     // done
@@ -24,6 +24,7 @@
 #include <unistd.h>
 #include <poll.h>
 #include "connector.h"
+#include "idgenerator.h"
 
 /**
  *  Begin of namespace
@@ -48,6 +49,15 @@ Sockets::Sockets(Loop *loop, Handler *handler) : _loop(loop), _handler(handler)
     _current = _udps.begin();
 }
 
+/**
+ *  Destructor
+ */
+Sockets::~Sockets()
+{
+    // stop the timer for the unused tcp connections
+    if (_timer) _loop->cancel(_timer, this);
+}
+
 /**
  *  Update the number of sockets
  *  Watch out: it is only possible to _increase_ the number of sockets
@@ -68,9 +78,26 @@ void Sockets::sockets(size_t count)
         
         // give the socket the same settings as all other sockets
         _udps.back().buffersize(_udps.front().buffersize());
+        _udps.back().batchsize(_udps.front().batchsize());
+        _udps.back().filter(_udps.front().filter());
+        _udps.back().lifetime(_udps.front().maxqueries(), _udps.front().maxage(), _udps.front().maxidle());
     }
 }
 
+/**
+ *  The max number of operations that can run at the same time
+ *  @return size_t
+ */
+size_t Sockets::capacity() const
+{
+    // in connected mode all queries for a nameserver go through the one socket of that nameserver, 
+    // so the number of sockets does not help (all lookups could be for the same nameserver)
+    if (_connect) return IdGenerator::capacity();
+
+    // every socket can handle the number of IDs that the generator allows
+    return _udps.size() * IdGenerator::capacity();
+}
+
 /**
  *  Invoke callback handlers for buffered raw responses
  *  @param   watcher   to keep track if the parent object remains valid
@@ -89,10 +116,26 @@ size_t Sockets::deliver(size_t maxcalls)
     for (auto &socket : _udps)
     {
         // pass the buffered responses to the lookup objects
-        result += socket.process(maxcalls);
+        size_t calls = socket.process(maxcalls);
         
-        // update number of calls
-        maxcalls -= result;
+        // update number of calls (the budget shrinks by the calls of this socket only)
+        result += calls; maxcalls -= calls;
+
+        // the call to userspace may have destructed this object
+        if (!watcher.valid()) return result;
+        
+        // leap out if we have made all the calls back to userspace
+        if (maxcalls == 0) return result;
+    }
+
+    // deliver the buffer from all connected udp sockets
+    for (auto &socket : _peers)
+    {
+        // pass the buffered responses to the lookup objects
+        size_t calls = socket.process(maxcalls);
+        
+        // update number of calls (the budget shrinks by the calls of this socket only)
+        result += calls; maxcalls -= calls;
 
         // the call to userspace may have destructed this object
         if (!watcher.valid()) return result;
@@ -113,10 +156,10 @@ size_t Sockets::deliver(size_t maxcalls)
     for (auto &socket : sockets)
     {
         // pass the buffered responses to the lookup objects
-        result += socket->process(maxcalls);
+        size_t calls = socket->process(maxcalls);
         
-        // update number of calls
-        maxcalls -= result;
+        // update number of calls (the budget shrinks by the calls of this socket only)
+        result += calls; maxcalls -= calls;
 
         // the call to userspace may have destructed this object
         if (!watcher.valid()) return result;
@@ -135,20 +178,120 @@ size_t Sockets::deliver(size_t maxcalls)
  */
 void Sockets::onUnused(Tcp *socket)
 {
-    // when a tcp socket is no longer in use (nobody is expecting any answers from it) we close it right away
+    // if the connection is already kept open there is nothing to do
+    if (socket->established() && socket->idle() > 0.0) return;
+
+    // number of unused connections that are already kept open
+    auto idle = std::count_if(_tcps.begin(), _tcps.end(), [](const std::shared_ptr<Tcp> &tcp) -> bool { return tcp->idle() > 0.0; });
+
+    // a connection that is still usable can be kept open for a while (if there is room for it)
+    if (socket->established() && idletime(socket) > 0.0 && size_t(idle) < _maxidle)
+    {
+        // remember since when it is unused
+        socket->idle(Now());
+
+        // make sure that it is closed in time
+        return timer();
+    }
+
+    // otherwise we close it right away
     _tcps.erase(std::remove_if(_tcps.begin(), _tcps.end(), [socket](const std::shared_ptr<Tcp> &tcp) -> bool {
         return socket == tcp.get();
     }), _tcps.end());
 }
 
+/**
+ *  How long an unused TCP connection is kept open (the server may want a shorter period)
+ *  @param  tcp         the connection
+ *  @return double
+ */
+double Sockets::idletime(const Tcp *tcp) const
+{
+    // if the server announced a timeout, we do not keep it open for longer
+    return tcp->keepalive() >= 0.0 ? std::min(_idletime, tcp->keepalive()) : _idletime;
+}
+
+/**
+ *  Set the timer to close the unused TCP connections
+ */
+void Sockets::timer()
+{
+    // find the time when the first unused connection should be closed
+    double expires = -1.0;
+    for (const auto &tcp : _tcps) if (tcp->idle() > 0.0 && (expires < 0.0 || tcp->idle() + idletime(tcp.get()) < expires)) expires = tcp->idle() + idletime(tcp.get());
+
+    // no changes are needed if the timer already expires at that time
+    if (_timer != nullptr && expires == _expires) return;
+
+    // if the timer is already running we have to reset it
+    if (_timer != nullptr) _loop->cancel(_timer, this);
+
+    // if there are no unused connections we do not need a timer
+    if (expires < 0.0) { _timer = nullptr; return; }
+
+    // set the new timer
+    _timer = _loop->timer(std::max(expires - Now(), 0.0), this);
+    _expires = expires;
+}
+
+/**
+ *  Method that is called when the timer expires
+ */
+void Sockets::expire()
+{
+    // forget the timer
+    _loop->cancel(_timer, this); _timer = nullptr;
+
+    // the current time
+    double now = Now();
+
+    // close the connections that have been unused for long enough
+    _tcps.erase(std::remove_if(_tcps.begin(), _tcps.end(), [this, now](const std::shared_ptr<Tcp> &tcp) -> bool {
+        return tcp->idle() > 0.0 && tcp->idle() + idletime(tcp.get()) <= now;
+    }), _tcps.end());
+
+    // set the timer for the other connections
+    timer();
+}
+
+/**
+ *  Find (or create) the connected socket for a nameserver
+ *  @param  ip          IP address of the nameserver
+ *  @return Udp
+ */
+Udp &Sockets::peer(const Ip &ip)
+{
+    // check if we already have a socket for this nameserver (there are normally just a few)
+    for (auto &socket : _peers) if (socket.peer() == ip) return socket;
+
+    // trick to avoid a compiler warning
+    Udp::Handler *udphandler = this;
+
+    // create a new socket
+    _peers.emplace_back(_loop, udphandler, ip);
+
+    // give the socket the same settings as all other sockets
+    _peers.back().buffersize(_udps.front().buffersize());
+    _peers.back().batchsize(_udps.front().batchsize());
+    _peers.back().filter(_udps.front().filter());
+    _peers.back().lifetime(_udps.front().maxqueries(), _udps.front().maxage(), _udps.front().maxidle());
+
+    // expose the socket
+    return _peers.back();
+}
+
 /**
  *  Send a query to a nameserver (+open the socket when needed)
  *  @param  ip      IP address of the nameserver
  *  @param  query   the query to send
+ *  @param  id      the ID with which the query is sent (output parameter)
  *  @return inbound
  */
-Inbound *Sockets::datagram(const Ip &ip, const Query &query)
+Inbound *Sockets::datagram(const Ip &ip, const Query &query, uint16_t &id)
 {
+    // in connected mode every nameserver has its own socket
+    if (_connect) return peer(ip).send(ip, query, id);
+
     // We have a simple algorithm to spread out the load over different sockets, so that we 
     // sometimes switch port-numbers for outgoing queries, which makes the system safer: when
     // all the sockets are in use (expect one or more responses), we use one socket for all
@@ -161,7 +304,7 @@ Inbound *Sockets::datagram(const Ip &ip, const Query &query)
         if (iter->subscribers() > 0) continue;
 
         // OK: send the query with this one
-        Inbound *inbound = iter->send(ip, query);
+        Inbound *inbound = iter->send(ip, query, id);
 
         // mark it as current so that we use this socket for subsequent queries in case all
         // the sockets are in use by now
@@ -172,8 +315,14 @@ Inbound *Sockets::datagram(const Ip &ip, const Query &query)
     }
 
     // this is the situation that all sockets have subscribers and we start using a fixed
-    // socket to allow the others to catch up
-    return _current->send(ip, query);
+    // socket to allow the others to catch up, but only as long as it has plenty of free IDs,
+    // after that we move on to the least busy socket (each socket has its own ID space)
+    if (_current->subscribers() >= IdGenerator::capacity()) _current = std::min_element(_udps.begin(), _udps.end(), [](const Udp &a, const Udp &b) { 
+        return a.subscribers() < b.subscribers(); 
+    });
+
+    // send the query
+    return _current->send(ip, query, id);
 }
 
 /**
@@ -187,8 +336,8 @@ Connecting *Sockets::connect(const Ip &ip, Connector *connector)
     // check if we already have a connection to this ip
     for (auto &tcp : _tcps)
     {
-        // is this the one?
-        if (tcp->ip() != ip) continue;
+        // is this the one? (a connection that has too many queries in flight is skipped)
+        if (tcp->ip() != ip || tcp->full()) continue;
         
         // subscribe to the connection, so that it will be notified when ready
         auto *result = tcp->subscribe(connector);
@@ -221,6 +370,20 @@ Connecting *Sockets::connect(const Ip &ip, Connector *connector)
     }
 }
 
+/**
+ *  Find an established TCP connection to a nameserver (that can be used right away)
+ *  @param  ip          IP address of the nameserver
+ *  @return Tcp         the connection, or nullptr if there is none
+ */
+Tcp *Sockets::established(const Ip &ip)
+{
+    // look for a connection that is already set up
+    for (auto &tcp : _tcps) if (tcp->ip() == ip && tcp->established() && !tcp->full()) return tcp.get();
+
+    // not found
+    return nullptr;
+}
+
 /**
  *  End of namespace
  */
@@ -16,8 +16,12 @@
 #include "../include/dnscpp/watcher.h"
 #include "../include/dnscpp/query.h"
 #include "../include/dnscpp/processor.h"
-#include "blocking.h"
+#include "../include/dnscpp/response.h"
+#include "../include/dnscpp/record.h"
+#include "../include/dnscpp/type.h"
+#include "../include/dnscpp/opt.h"
 #include "connector.h"
+#include "idgenerator.h"
 #include <cassert>
 
 /**
@@ -25,6 +29,18 @@
  */
 namespace DNS {
 
+/**
+ *  The code of the edns-tcp-keepalive option (RFC 7828)
+ *  @var uint16_t
+ */
+static const uint16_t KeepaliveOption = 11;
+
+/**
+ *  Generator for the query IDs
+ *  @var IdGenerator
+ */
+static IdGenerator randomids;
+
 /**
  *  Constructor
  *  @param  loop        user space event loop
@@ -143,62 +159,142 @@ int Tcp::error() const
     return error;
 }
 
+/**
+ *  Is the ID space of the connection (almost) exhausted? New lookups should then use an other connection
+ *  @return bool
+ */
+bool Tcp::full() const
+{
+    // we keep at most half of the IDs in use, so that a random ID is almost always free
+    return _pending >= IdGenerator::capacity() || subscribers() >= IdGenerator::capacity();
+}
+
 /**
  *  Send a full query
- *  This is a blocking operation. Although it would have been better to make this
- *  non-blocking operation, it would make the code more complex and in reality we
- *  only send small messages over the socket, so we do not expect any buffering to
- *  take place anyway - so we have kept the code simple
+ *  The query is added to the output buffer, and will be written on the next call to flush(),
+ *  so that all queries that are sent over this connection in the meantime are pipelined
  *  @param  query       the query to send
+ *  @param  id          the ID with which the query is sent (output parameter)
  *  @return Inbound     the object to which you can subscribe for responses
  */
-Inbound *Tcp::send(const Query &query)
+Inbound *Tcp::send(const Query &query, uint16_t &id)
 {
-    // check if this query id is inflight
-    if (_queryids.count(query.id()))
-    {
-        // it's already inflight. we'll put it in a queue to be sent later
-        _awaiting.emplace(query.id(), query);
+    // if the connection was already lost in the meantime
+    if (_state != State::connected) return nullptr;
 
-        // We'll pretend everything went OK. If it later turns out we couldn't
-        // send it after all, we'll enter the `fail()` method.
-        return this;
-    }
+    // the connection is in use (again)
+    _idle = 0.0;
 
-    // this query is not inflight, let's remember that it is in fact in flight (if it succeeds)
-    if (auto *inbound = sendimpl(query)) return _queryids.insert(query.id()), inbound;
+    // pick an ID that is not yet in use on this connection (lookups for the same question, or for 
+    // questions with the same ID, can then be sent right away, without waiting for each other)
+    if (!allocate(id)) return nullptr;
 
-    // we failed
-    return nullptr;
+    // was the output buffer empty before?
+    bool wasempty = _output.empty();
+
+    // add the query to the output buffer
+    append(query, id);
+
+    // remember that the ID is in flight
+    _inflight.set(id); _pending += 1;
+
+    // if this is the first query, we tell the parent that we are active, so that it will flush us soon
+    if (wasempty && _events == 1) _handler->onActive(this);
+
+    // everything went OK!
+    return this;
 }
 
 /**
- *  Blocking send this query
- *  @param  query  The query
- *  @return this or nullptr if something went wrong
+ *  Pick a random query ID that is not yet in use on this connection
+ *  @param  id          the ID (output parameter)
+ *  @return bool        false if all IDs are in use
  */
-Inbound *Tcp::sendimpl(const Query &query)
+bool Tcp::allocate(uint16_t &id) const
 {
-    // if the connection was already lost in the meantime
-    if (_state != State::connected) return nullptr;
-    
-    // make the socket blocking
-    Blocking blocking(_fd);
+    // an ID is in use when a response is still expected for it, or when a lookup is still subscribed to it
+    auto free = [this](uint16_t id) { return !_inflight.test(id) && _processors.find(_ip, id) == nullptr; };
 
-    // the first two bytes should contain the message size
-    uint16_t size = htons(query.size());
+    // when less than half of the IDs are in use (this is normally the case) a random ID is 
+    // almost always free, so we only have to try a couple of times
+    for (size_t i = 0; i < 16; ++i) if (free(id = randomids.generate())) return true;
+
+    // the ID space is crowded, we check the IDs that follow the last random one (zero is not used)
+    for (size_t i = 1; i < 65535; ++i) if (free(id = id % 65535 + 1)) return true;
+
+    // all IDs are in use
+    return false;
+}
+
+/**
+ *  Add a query to the output buffer
+ *  @param  query       the query
+ *  @param  id          the ID with which the query is sent
+ */
+void Tcp::append(const Query &query, uint16_t id)
+{
+    // the query data
+    auto *data = query.data(); size_t size = query.size();
 
-    // send the size
-    auto result1 = ::send(_fd, &size, sizeof(size), MSG_NOSIGNAL | MSG_MORE);
+    // if unused connections are kept open, we tell the server that we like to keep the connection open (with
+    // an empty edns-tcp-keepalive option), this is only possible if the query ends with an OPT record without options
+    bool keepalive = ((Tcp::Handler *)_handler)->pooled() && size >= HFIXEDSZ + 11 && data[size - 11] == 0 && ns_get16(data + size - 10) == ns_t_opt && ns_get16(data + size - 2) == 0;
 
-    // was this a success?
-    if (result1 < 2) return nullptr;
+    // the size of the message in the frame (the option takes four bytes)
+    size_t framesize = keepalive ? size + 4 : size;
 
-    // now send the entire query
-    auto result2 = ::send(_fd, query.data(), query.size(), MSG_NOSIGNAL);
+    // the first two bytes of the frame contain the message size (in network byte order)
+    _output.push_back(framesize >> 8);
+    _output.push_back(framesize & 0xff);
 
-    // report the result
-    return result2 >= (ssize_t)query.size() ? this : nullptr;
+    // followed by the query itself (with the ID of this connection)
+    _output.insert(_output.end(), data, data + size);
+    ns_put16(id, _output.data() + _output.size() - size);
+
+    // done if there is no option to add
+    if (!keepalive) return;
+
+    // the option has a code and an (empty) value, the size of the OPT data is updated too
+    unsigned char option[] = { KeepaliveOption >> 8, KeepaliveOption & 0xff, 0, 0 };
+    _output[_output.size() - 1] = sizeof(option);
+    _output.insert(_output.end(), option, option + sizeof(option));
+}
+
+/**
+ *  Write the output buffer to the socket (as far as this is possible without blocking)
+ */
+void Tcp::flush()
+{
+    // nothing to do if the connection is not (or no longer) usable, or when there is nothing to send
+    if (_state != State::connected || _output.empty()) return;
+
+    // write all frames at once
+    auto result = ::send(_fd, _output.data(), _output.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+
+    // if the kernel buffer is full, we wait for the socket to become writable
+    if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return monitor(3);
+
+    // on other errors the connection is lost (the subscribers will hear about it)
+    if (result < 0) return fail(State::lost);
+
+    // forget the bytes that were written
+    _output.erase(_output.begin(), _output.begin() + result);
+
+    // if not everything could be written we have to wait for writability
+    monitor(_output.empty() ? 1 : 3);
+}
+
+/**
+ *  Change the events for which the socket is monitored
+ *  @param  events      1 = readability, 3 = readability and writability
+ */
+void Tcp::monitor(int events)
+{
+    // not necessary if nothing changes
+    if (_events == events) return;
+
+    // update the event loop
+    _identifier = _loop->update(_identifier, _fd, _events = events, this);
 }
 
 /**
@@ -227,7 +323,7 @@ void Tcp::upgrade()
     _state = State::connected;
 
     // we no longer monitor for writability, but for readability instead
-    _loop->update(_identifier, _fd, 1, this);
+    monitor(1);
     
     // In theory we should call '_handler->onBuffered()', which is conceptually more 
     // correct because it will trigger the lookups via the procedure in Core, and Core
@@ -238,6 +334,9 @@ void Tcp::upgrade()
     
     // reset the connectors
     _connectors.clear();
+
+    // the queries that the connectors sent can be written right away
+    flush();
 }
 
 /**
@@ -293,6 +392,12 @@ void Tcp::notify()
     // if the socket is not yet connected, it might be connected right now
     if (_state == State::connecting) return upgrade();
 
+    // if we were waiting for the socket to become writable, we can write the rest of the queries
+    if (_events == 3) flush();
+
+    // the connection might have been lost while writing
+    if (_state != State::connected) return;
+
     // We can be in two receive states: the first state is that we're waiting for the
     // size of the buffer. The second state is that we are waiting for the response content itself.
     // To determine in what state we're in, we can check how many bytes have been transferred.
@@ -327,40 +432,45 @@ void Tcp::notify()
     // continue waiting if we have not yet received everything there is
     if (expected() > 0) return;
 
-    // all data has been received, we can move the response content into a deferred list to be processed later
-    add(_ip, move(_buffer));
+    // all data has been received, we can move the response content into the inbox to be processed later
+    // (we get an other buffer back, that is used for the next response)
+    add(_ip, _buffer);
     
     // for the next response we empty the buffer again
     _transferred = 0;
 }
 
 /**
- *  A response payload was received with this ID
- *  @param  id    The identifier
+ *  A response was received
+ *  @param  id          the ID with which the response was received
+ *  @param  response    the received response
  */
-void Tcp::onReceivedId(uint16_t id)
+void Tcp::onReceived(uint16_t id, const Response &response)
 {
     // if the connection was already lost in the meantime
     if (_state != State::connected) return;
 
-    // find the list of queries that are awaiting to be sent
-    auto iter = _awaiting.find(id);
-
-    // if there are no queries with this ID, we can leap out now
-    if (iter == _awaiting.end())
+    // the server might tell us how long it keeps idle connections open (RFC 7828)
+    for (size_t i = 0; i < response.additional(); ++i)
     {
-        // forget that this query is in flight
-        _queryids.erase(id);
+        // find the record
+        const unsigned char *name, *fields;
+        if (!response.locate(ns_s_ar, i, name, fields)) break;
 
-        // leap out
-        return;
-    }
+        // skip records that are not OPT records (without parsing them)
+        if (ns_get16(fields) != ns_t_opt) continue;
+
+        // parse the record
+        Record record;
+        if (!record.parse(response, ns_s_ar, i) || !OPT::valid(record)) continue;
 
-    // send it now
-    if (sendimpl(iter->second)) _awaiting.erase(iter);
+        // look for the edns-tcp-keepalive option (the timeout is in units of 100 milliseconds)
+        const unsigned char *data; uint16_t size;
+        if (OPT(response, record).option(KeepaliveOption, data, size) && size == 2) _keepalive = ns_get16(data) / 10.0;
+    }
 
-    // oops, forget about this tcp connection
-    else fail(State::failed);
+    // the ID is no longer in flight, and can be used for a next query
+    if (_inflight.test(id)) { _inflight.reset(id); _pending -= 1; }
 }
 
 /**
@@ -411,14 +521,8 @@ size_t Tcp::process(size_t maxcalls)
     // if the connection was lost while we have subscribers, we notify them as well
     while (maxcalls > calls && _state == State::lost && !_processors.empty())
     {
-        // front of the set
-        auto iter = _processors.begin();
-
-        // get the oldest processor
-        auto *processor = std::get<2>(*iter);
-
-        // remove from the set
-        _processors.erase(iter);
+        // get one of the processors, and remove it from the table
+        auto *processor = _processors.pop();
         
         // notify the processor
         if (!processor->onLost(_ip)) continue;
@@ -448,6 +552,9 @@ Connecting *Tcp::subscribe(Connector *connector)
     // cases (even state_lost!) subscribing is possible and will eventually result in a call
     // to either onConnected() or onFailed())
     if (_state == State::failed) return nullptr;
+
+    // the connection is in use (again)
+    _idle = 0.0;
     
     // add the connector to be notified later when the connection is available
     _connectors.push_back(connector);
@@ -486,6 +593,9 @@ void Tcp::reset()
     // if we still have connectors or subscribers this should not do anything
     if (subscribers() > 0 || !_connectors.empty()) return;
     
+    // note that the IDs of queries that are still in flight are not released: if the connection
+    // is kept open, their responses may still come in and must not reach a next lookup
+
     // there are no more subscribers, we are going to tell the parent about it
     auto *handler = (Tcp::Handler *)_handler;
     
@@ -4,7 +4,12 @@
 #include "../include/dnscpp/response.h"
 #include "../include/dnscpp/processor.h"
 #include "../include/dnscpp/query.h"
+#include "../include/dnscpp/socketfilter.h"
+#include "../include/dnscpp/now.h"
+#include "idgenerator.h"
 #include <unistd.h>
+#include <string.h>
+#include <errno.h>
 #include <cassert>
 
 /**
@@ -12,13 +17,27 @@
  */
 namespace DNS {
 
+/**
+ *  Generator for the random IDs of outgoing queries
+ *  @var IdGenerator
+ */
+static IdGenerator randomids;
+
 /**
  *  Constructor does nothing but store a pointer to a Udp object.
  *  Sockets are opened lazily
  *  @param  loop        the event loop
  *  @param  handler     object that is notified in case of events
  */
-Udp::Udp(Loop *loop, Socket::Handler *handler) : Socket(handler), _loop(loop) {}
+Udp::Udp(Loop *loop, Socket::Handler *handler) : Socket(handler), _loop(loop), _datagrams(16) {}
+
+/**
+ *  Constructor for a socket that is connected to a single nameserver
+ *  @param  loop        the event loop
+ *  @param  handler     object that is notified in case of events
+ *  @param  peer        the nameserver to connect to
+ */
+Udp::Udp(Loop *loop, Socket::Handler *handler, const Ip &peer) : Socket(handler), _loop(loop), _peer(peer), _connected(true), _datagrams(16) {}
 
 /**
  *  Closes the file descriptor
@@ -37,25 +56,77 @@ int Udp::setintopt(int optname, int32_t optval)
     return setsockopt(_fd, SOL_SOCKET, optname, &optval, 4);
 }
 
+/**
+ *  Create the file descriptor
+ *  @param  family      AF_INET or AF_INET6
+ *  @return int
+ */
+static int create(int family)
+{
+    // the socket is non-blocking, queries that cannot be sent right away stay in the outbox
+    return socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+}
+
+/**
+ *  Create a dual-stack socket: an ipv6 socket that can also reach ipv4 addresses
+ *  @return int
+ */
+static int dualstack()
+{
+    // create an ipv6 socket
+    int fd = create(AF_INET6);
+
+    // check for success
+    if (fd < 0) return -1;
+
+    // ipv4 traffic must be allowed too (this is normally the default, but it depends on a system setting)
+    int value = 0;
+
+    // update the socket
+    if (setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &value, sizeof(value)) == 0) return fd;
+
+    // this host does not support it
+    ::close(fd);
+
+    // failure
+    return -1;
+}
+
 /**
  *  Open the socket
- *  @param  version
  *  @return bool
  */
-bool Udp::open(int version)
+bool Udp::open()
 {
     // if already open
     if (_fd >= 0) return true;
 
-    // try to open it (note that we do not set the NONBLOCK option, because we have not implemented
-    // buffering for the sendto() call (this could be a future optimization)
-    _fd = socket(version == 6 ? AF_INET6 : AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    // a connected socket uses the address family of its peer
+    if (_connected) _fd = create(_peer.version() == 6 ? AF_INET6 : AF_INET);
+
+    // other sockets are dual-stack, ipv4 nameservers are reached via ipv4-mapped addresses
+    else _fd = dualstack();
+
+    // remember whether ipv4 addresses have to be mapped
+    _dualstack = !_connected && _fd >= 0;
+
+    // on hosts where ipv6 is disabled we fall back to a plain ipv4 socket
+    if (!_connected && _fd < 0) _fd = create(AF_INET);
 
     // check for success
     if (_fd < 0) return false;
 
+    // the lifetime of the port starts now
+    _opened = Now(); _queries = 0;
+
+    // a connected socket only talks to its peer (and hears it from the kernel when the peer is unreachable)
+    if (_connected && !connect()) { ::close(_fd); _fd = -1; return false; }
+
+    // let the kernel drop datagrams that can not be a response (if that fails we still have the checks in user space)
+    if (_filter) SocketFilter::attach(_fd);
+
     // we want to be notified when the socket receives data
-    _identifier = _loop->add(_fd, 1, this);
+    _identifier = _loop->add(_fd, _events = 1, this);
 
     // if there is a buffer size to set, do so
     if (_buffersize == 0) return true;
@@ -68,11 +139,51 @@ bool Udp::open(int version)
     return true;
 }
 
+/**
+ *  Connect the socket to the peer
+ *  @return bool
+ */
+bool Udp::connect()
+{
+    // the address of the nameserver (we use an ipv6 struct because that is also big enough for ipv4)
+    struct sockaddr_in6 address;
+    memset(&address, 0, sizeof(address));
+
+    // should we connect in the ipv4 or ipv6 fashion?
+    if (_peer.version() == 6)
+    {
+        // fill the members
+        address.sin6_family = AF_INET6;
+        address.sin6_port = htons(53);
+
+        // copy the address
+        memcpy(&address.sin6_addr, (const struct in6_addr *)_peer, sizeof(struct in6_addr));
+    }
+    else
+    {
+        // the ipv6 struct is big enough to hold an ipv4 address
+        struct sockaddr_in *info = (struct sockaddr_in *)&address;
+
+        // fill the members
+        info->sin_family = AF_INET;
+        info->sin_port = htons(53);
+
+        // copy address
+        memcpy(&info->sin_addr, (const struct in_addr *)_peer, sizeof(struct in_addr));
+    }
+
+    // connect (for udp this does not block, it only sets the default destination)
+    return ::connect(_fd, (struct sockaddr *)&address, _peer.version() == 6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in)) == 0;
+}
+
 /**
  *  Close the socket
  */
 void Udp::close()
 {
+    // the previous socket is no longer needed
+    drained();
+
     // if already closed
     if (!valid()) return;
 
@@ -83,7 +194,96 @@ void Udp::close()
     ::close(_fd);
 
     // remember that socket is closed
-    _fd = -1; _identifier = nullptr;
+    _fd = -1; _identifier = nullptr; _events = 0;
+
+    // a closed socket does not have to be closed when idle
+    wakeup();
+
+    // queries that were not yet sent are no longer relevant
+    _outbox.clear();
+}
+
+/**
+ *  Close the filedescriptor that was draining after a rotation
+ */
+void Udp::drained()
+{
+    // if there is no such socket
+    if (_draining < 0) return;
+
+    // tell the event loop that we are no longer are interested in notifications
+    _loop->remove(_drainid, _draining, this);
+
+    // close the socket
+    ::close(_draining);
+
+    // remember that socket is closed
+    _draining = -1; _drainid = nullptr;
+}
+
+/**
+ *  Is the socket due for a new port (according to the lifetime policy)?
+ *  @return bool
+ */
+bool Udp::due() const
+{
+    // check the number of queries
+    if (_maxqueries > 0 && _queries >= _maxqueries) return true;
+
+    // check the age
+    return _maxage > 0.0 && Now() - _opened >= _maxage;
+}
+
+/**
+ *  Give the socket a new port
+ */
+void Udp::rotate()
+{
+    // if nobody is waiting for responses we can simply close the socket
+    if (_processors.empty()) return close();
+
+    // if an even older socket was still draining, it is closed now (responses to it are at least one lifetime late)
+    drained();
+
+    // the current socket is only used for receiving the last responses
+    _draining = _fd; _drainid = _loop->update(_identifier, _fd, 1, this);
+
+    // the next query opens a new socket
+    _fd = -1; _identifier = nullptr; _events = 0;
+
+    // queries that were waiting to be sent will go over the new socket, we make sure they are soon flushed
+    if (!_outbox.empty()) _handler->onActive(this);
+}
+
+/**
+ *  Remember that the peer is unreachable, its subscribers are notified when the socket is processed
+ */
+void Udp::unreachable()
+{
+    // remember the error
+    _refused = true;
+
+    // tell the parent that we are active, so that we are soon processed
+    _handler->onActive(this);
+}
+
+/**
+ *  Should a socket filter be attached
+ *  @param  value       the new setting
+ */
+void Udp::filter(bool value)
+{
+    // not necessary if nothing changes
+    if (_filter == value) return;
+
+    // update the setting
+    _filter = value;
+
+    // if the socket is not yet open the filter is attached when it is opened
+    if (!valid()) return;
+
+    // update the socket
+    if (value) SocketFilter::attach(_fd); else SocketFilter::detach(_fd);
 }
 
 /**
@@ -93,109 +293,216 @@ void Udp::close()
  */
 void Udp::reset()
 {
-    // we simply close the socket, it will be reopenen when we need it for the next datagram
-    close();
+    // without a lifetime policy we simply close the socket, it will be reopened (with a new port) when we need it for the next datagram
+    if (_maxqueries == 0 && _maxage == 0.0) return close();
+
+    // otherwise the socket stays open, but the socket that was draining after a rotation is no longer needed
+    drained();
+
+    // unless it is time for a new port anyway
+    if (due()) return close();
+
+    // an idle socket is not kept open forever, because that would keep the event loop running
+    if (_maxidle > 0.0 && _timer == nullptr && valid()) _timer = _loop->timer(_maxidle, this);
+}
+
+/**
+ *  Method that is called when the idle timer expires
+ */
+void Udp::expire()
+{
+    // forget the timer
+    wakeup();
+
+    // close the socket if it is still idle (it is reopened with a new port when it is needed again)
+    if (subscribers() == 0) close();
+}
+
+/**
+ *  Stop the idle timer (if it is running)
+ */
+void Udp::wakeup()
+{
+    // nothing to do if there is no timer
+    if (_timer == nullptr) return;
+
+    // cancel it
+    _loop->cancel(_timer, this); _timer = nullptr;
 }
 
 /**
  *  Send a query over this socket
+ *  The query is added to the outbox, and will be sent on the next call to flush()
  *  @param  ip          IP address of the nameserver
  *  @param  query       the query to send
  *  @return Inbound     the object that will receive the inbound response
  */
-Inbound *Udp::send(const Ip &ip, const Query &query)
+Inbound *Udp::send(const Ip &ip, const Query &query, uint16_t &id)
 {
+    // the socket is no longer idle
+    wakeup();
+
+    // if the socket has been in use for long enough, it gets a new port
+    if (valid() && due()) rotate();
+
     // if the socket is not yet open we need to open it
-    if (!open(ip.version())) return nullptr;
+    if (!open()) return nullptr;
 
-    // should we bind in the ipv4 or ipv6 fashion?
-    if (ip.version() == 6)
-    {
-        // structure to initialize
-        struct sockaddr_in6 info;
+    // a socket without ipv6 support can not reach ipv6 nameservers
+    if (ip.version() == 6 && !_dualstack && !_connected) return nullptr;
 
-        // fill the members
-        info.sin6_family = AF_INET6;
-        info.sin6_port = htons(53);
-        info.sin6_flowinfo = 0;
-        info.sin6_scope_id = 0;
+    // pick an ID that is not yet in use for this nameserver
+    if (!allocate(ip, id)) return nullptr;
 
-        // copy the address
-        memcpy(&info.sin6_addr, (const struct in6_addr *)ip, sizeof(struct in6_addr));
+    // was the outbox empty before?
+    bool wasempty = _outbox.empty();
 
-        // pass on to other method
-        if (!send((struct sockaddr *)&info, sizeof(struct sockaddr_in6), query)) return nullptr;
-    }
-    else
+    // add the query to the outbox
+    _outbox.add(ip, query, id, _dualstack);
+
+    // one more query was sent from this port
+    _queries += 1;
+
+    // if this is the first query, we tell the parent that we are active, so that it will flush us soon
+    if (wasempty && _events == 1) _handler->onActive(this);
+
+    // everything went OK!
+    return this;
+}
+
+/**
+ *  Pick a random query ID that is not yet in use for a nameserver. Responses are dispatched
+ *  on the combination of address and ID, so every socket has a separate ID space per nameserver
+ *  @param  ip          the nameserver
+ *  @param  id          the ID (output parameter)
+ *  @return bool        false if all IDs are in use
+ */
+bool Udp::allocate(const Ip &ip, uint16_t &id) const
+{
+    // when less than half of the IDs are in use (this is normally the case) a random ID is 
+    // almost always free, so we only have to try a couple of times
+    for (size_t i = 0; i < 16; ++i) if (_processors.find(ip, id = randomids.generate()) == nullptr) return true;
+
+    // the ID space is crowded, we check the IDs that follow the last random one (zero is not used)
+    for (size_t i = 1; i < 65535; ++i) if (_processors.find(ip, id = id % 65535 + 1) == nullptr) return true;
+
+    // all IDs are in use
+    return false;
+}
+
+/**
+ *  Send all queries in the outbox (as far as this is possible without blocking)
+ */
+void Udp::flush()
+{
+    // nothing to do if the socket is closed or when there is nothing to send
+    if (!valid() || _outbox.empty()) return;
+
+    // send the queries, if the socket would block, we wait for it to become writable
+    monitor(_outbox.send(_fd, _connected) ? 1 : 3);
+
+    // a connected socket might have heard that the peer refused one of the earlier datagrams
+    if (_outbox.refused()) unreachable();
+}
+
+/**
+ *  Invoke callback handlers for buffered raw responses
+ *  @param   maxcalls  the max number of callback handlers to invoke
+ *  @return  number of callback handlers invoked
+ */
+size_t Udp::process(size_t maxcalls)
+{
+    // use a watcher in case object is destructed in the meantime
+    Watcher watcher(this);
+
+    // deliver the responses that were already received
+    size_t calls = Socket::process(maxcalls);
+
+    // stop if userspace destructed us, or when the peer is still reachable
+    if (!watcher.valid() || !_refused) return calls;
+
+    // all subscribers are waiting for the peer, so they all have to hear that it is unreachable
+    while (maxcalls > calls && !_processors.empty())
     {
-        // structure to initialize
-        struct sockaddr_in info;
+        // get one of the processors, and remove it from the table
+        auto *processor = _processors.pop();
 
-        // fill the members
-        info.sin_family = AF_INET;
-        info.sin_port = htons(53);
+        // notify the processor
+        if (!processor->onUnreachable(_peer)) continue;
 
-        // copy address
-        memcpy(&info.sin_addr, (const struct in_addr *)ip, sizeof(struct in_addr));
+        // update bookkeeping
+        calls += 1;
 
-        // pass on to other method
-        if (!send((const sockaddr *)&info, sizeof(struct sockaddr_in), query)) return nullptr;
+        // stop if userspace destructed us
+        if (!watcher.valid()) return calls;
     }
 
-    // everything went OK!
-    return this;
+    // if some subscribers still have to be notified, we do that in the next iteration
+    if (!_processors.empty()) return calls;
+
+    // the error has been dealt with
+    _refused = false;
+
+    // the socket is no longer in use, it is reopened for the next query
+    reset();
+
+    // done
+    return calls;
 }
 
 /**
- *  Send a query to a certain nameserver
- *  @param  address     target address
- *  @param  size        size of the address
- *  @param  query       query to send
- *  @return bool
+ *  Change the events for which the socket is monitored
+ *  @param  events      1 = readability, 3 = readability and writability
  */
-bool Udp::send(const struct sockaddr *address, size_t size, const Query &query)
+void Udp::monitor(int events)
 {
-    // send over the socket
-    // @todo include MSG_DONTWAIT + implement non-blocking????
-    return sendto(_fd, query.data(), query.size(), MSG_NOSIGNAL, address, size) >= 0;
+    // not necessary if nothing changes
+    if (_events == events) return;
+
+    // update the event loop
+    _identifier = _loop->update(_identifier, _fd, _events = events, this);
 }
 
 /**
- *  Method that is called from user-space when the socket becomes readable.
- *  @param  now
+ *  Method that is called from user-space when the socket becomes readable (or writable).
  */
 void Udp::notify()
 {
-    // do nothing if there is no socket (how is that possible!?)
-    if (!valid()) return;
-
-    // structure will hold the source address (we use an ipv6 struct because that is also big enough for ipv4)
-    struct sockaddr_in6 from; socklen_t fromlen = sizeof(from);
+    // if we were waiting for the socket to become writable, we can send out more queries
+    if (valid() && _events == 3) flush();
 
-    // the buffer to receive the response in
-    std::vector<unsigned char> buffer;
+    // read the messages from the socket, and from the socket that is still draining after a rotation
+    if (valid()) receive(_fd);
+    if (_draining >= 0) receive(_draining);
+}
 
+/**
+ *  Receive all datagrams that are waiting on a filedescriptor
+ *  @param  fd          the filedescriptor to read from
+ */
+void Udp::receive(int fd)
+{
     // read all messages until depleted
     while (true)
     {
-        // make the buffer large enough
-        buffer.resize(EDNSPacketSize);
+        // receive as many messages as fit in our slots (this does not block)
+        auto count = _datagrams.receive(fd);
 
-        // receive the message (the DONTWAIT option is needed because this is a blocking socket, but we dont want to block now)
-        auto bytes = recvfrom(_fd, buffer.data(), buffer.size(), MSG_DONTWAIT, (struct sockaddr *)&from, &fromlen);
+        // a connected socket hears it here when the peer refused one of our datagrams (the error
+        // is reported only once, so we can proceed with reading the datagrams that follow)
+        if (count < 0 && _connected && errno == ECONNREFUSED) { unreachable(); continue; }
 
-        // if there were no bytes, leap out
-        if (bytes <= 0) break;
+        // if there were no messages, leap out
+        if (count <= 0) break;
 
-        // shrink to fit
-        buffer.resize(bytes);
+        // add all messages to the buffer
+        for (int i = 0; i < count; ++i) add(_datagrams.address(i), _datagrams.data(i), _datagrams.size(i));
 
-        // add to the buffer
-        add((const sockaddr *)&from, move(buffer));
+        // if not all slots were filled, the socket has been drained
+        if (count < (int)_datagrams.capacity()) break;
     }
 }
 
-
 /**
  *  End namespace
  */
@@ -0,0 +1,200 @@
+/**
+ *  Corpus.h
+ *
+ *  Helper to construct responses, and a corpus of typical responses, that is
+ *  used by the parser benchmark and by the parser tests
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <arpa/nameser.h>
+#include <vector>
+#include <string>
+
+/**
+ *  Helper class to construct a response
+ */
+class Builder
+{
+private:
+    /**
+     *  The message
+     *  @var std::vector
+     */
+    std::vector<unsigned char> _data;
+
+    /**
+     *  Helper method to add a number
+     *  @param  value
+     */
+    void put16(uint16_t value) { _data.push_back(value >> 8); _data.push_back(value); }
+    void put32(uint32_t value) { put16(value >> 16); put16(value); }
+
+public:
+    /**
+     *  Constructor
+     *  @param  rcode       the result code
+     *  @param  an          number of records in the answer section
+     *  @param  ns          number of records in the authority section
+     *  @param  ar          number of records in the additional section
+     */
+    Builder(uint16_t rcode, uint16_t an, uint16_t ns, uint16_t ar)
+    {
+        // id and flags
+        put16(0x1234); put16(0x8180 | rcode);
+
+        // the number of records
+        put16(1); put16(an); put16(ns); put16(ar);
+    }
+
+    /**
+     *  Add a name (uncompressed, or a pointer if the offset is set)
+     *  @param  name        the name
+     *  @param  offset      offset of an earlier name to point to
+     *  @return size_t      offset of the name
+     */
+    size_t name(const std::string &name, uint16_t offset = 0)
+    {
+        // remember where the name starts
+        size_t result = _data.size();
+
+        // add a pointer
+        if (offset > 0)
+        {
+            // the pointer is all there is
+            put16(0xc000 | offset);
+            return result;
+        }
+
+        // add the labels
+        size_t start = 0;
+        while (start < name.size())
+        {
+            size_t dot = name.find('.', start);
+            if (dot == std::string::npos) dot = name.size();
+            _data.push_back(dot - start);
+            _data.insert(_data.end(), name.begin() + start, name.begin() + dot);
+            start = dot + 1;
+        }
+
+        // the root label
+        _data.push_back(0);
+
+        // done
+        return result;
+    }
+
+    /**
+     *  Add the question
+     *  @param  name        the name
+     *  @param  type        the type
+     */
+    void question(const std::string &name, uint16_t type) { this->name(name); put16(type); put16(ns_c_in); }
+
+    /**
+     *  Add the fixed fields of a record
+     *  @param  type        the type
+     *  @param  rdlength    size of the data
+     */
+    void fields(uint16_t type, uint16_t rdlength) { put16(type); put16(type == ns_t_opt ? 1232 : ns_c_in); put32(type == ns_t_opt ? 0 : 3600); put16(rdlength); }
+
+    /**
+     *  Add raw data
+     *  @param  data        the data
+     */
+    void raw(const std::vector<unsigned char> &data) { _data.insert(_data.end(), data.begin(), data.end()); }
+
+    /**
+     *  Add a record that holds a name
+     *  @param  owner       offset of the owner
+     *  @param  type        the type
+     *  @param  target      the name
+     *  @param  prefix      number of bytes in front of the name (like the preference of an MX record)
+     *  @return size_t      offset of the target name
+     */
+    size_t target(uint16_t owner, uint16_t type, const std::string &target, size_t prefix = 0)
+    {
+        name("", owner); fields(type, prefix + target.size() + 2);
+        for (size_t i = 0; i < prefix; ++i) _data.push_back(0);
+        return name(target);
+    }
+
+    /**
+     *  Add a soa record
+     *  @param  owner       offset of the owner
+     *  @param  nameserver  the primary nameserver
+     *  @param  email       the email address
+     */
+    void soa(uint16_t owner, const std::string &nameserver, const std::string &email)
+    {
+        name("", owner); fields(ns_t_soa, nameserver.size() + email.size() + 4 + 20);
+        name(nameserver); name(email);
+        for (int i = 0; i < 5; ++i) put32(3600);
+    }
+
+    /**
+     *  Expose the data
+     *  @return std::vector
+     */
+    const std::vector<unsigned char> &data() const { return _data; }
+};
+
+/**
+ *  The corpus of responses
+ *  @return std::vector
+ */
+inline std::vector<std::vector<unsigned char>> corpus()
+{
+    // the result
+    std::vector<std::vector<unsigned char>> result;
+
+    // an A record behind a CNAME, with an OPT record
+    Builder a(ns_r_noerror, 2, 0, 1);
+    a.question("www.example.com", ns_t_a);
+    auto cname = a.target(12, ns_t_cname, "www.example.com.cdn.provider.net");
+    a.name("", cname); a.fields(ns_t_a, 4); a.raw({ 93, 184, 216, 34 });
+    a.name(""); a.fields(ns_t_opt, 0);
+    result.push_back(a.data());
+
+    // a number of AAAA records
+    Builder aaaa(ns_r_noerror, 4, 0, 1);
+    aaaa.question("mail.example.org", ns_t_aaaa);
+    for (int i = 0; i < 4; ++i) { aaaa.name("", 12); aaaa.fields(ns_t_aaaa, 16); aaaa.raw({ 0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, (unsigned char)i }); }
+    aaaa.name(""); aaaa.fields(ns_t_opt, 0);
+    result.push_back(aaaa.data());
+
+    // mail exchangers, with glue in the additional section
+    Builder mx(ns_r_noerror, 3, 0, 3);
+    mx.question("example.net", ns_t_mx);
+    std::vector<size_t> targets;
+    for (auto host : { "mx1.mail.example.net", "mx2.mail.example.net", "backup.mailhost.example.com" }) targets.push_back(mx.target(12, ns_t_mx, host, 2));
+    for (auto target : targets) { mx.name("", target); mx.fields(ns_t_a, 4); mx.raw({ 10, 0, 0, 1 }); }
+    result.push_back(mx.data());
+
+    // a referral with nameservers and glue
+    Builder ns(ns_r_noerror, 0, 4, 4);
+    ns.question("host.department.example.co.uk", ns_t_a);
+    targets.clear();
+    for (auto host : { "ns1.example.co.uk", "ns2.example.co.uk", "ns3.dnsprovider.com", "ns4.dnsprovider.com" }) targets.push_back(ns.target(12, ns_t_ns, host));
+    for (auto target : targets) { ns.name("", target); ns.fields(ns_t_a, 4); ns.raw({ 192, 0, 2, 53 }); }
+    result.push_back(ns.data());
+
+    // a non-existing domain with a soa record
+    Builder nx(ns_r_nxdomain, 0, 1, 1);
+    nx.question("doesnotexist.example.com", ns_t_a);
+    nx.soa(12, "ns1.example.com", "hostmaster.example.com");
+    nx.name(""); nx.fields(ns_t_opt, 0);
+    result.push_back(nx.data());
+
+    // done
+    return result;
+}
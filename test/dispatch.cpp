@@ -0,0 +1,131 @@
+/**
+ *  Dispatch.cpp
+ *
+ *  Benchmark program that compares the cost of subscribing, dispatching
+ *  and unsubscribing lookups: the std::set that was used before versus
+ *  the flat table that is used by the sockets nowadays
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include <dnscpp.h>
+#include <dnscpp/processors.h>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <set>
+#include <tuple>
+
+/**
+ *  Number of rounds to run per benchmark
+ *  @var size_t
+ */
+static const size_t rounds = 100;
+
+/**
+ *  The old approach: a red-black tree with tuples
+ */
+class Tree
+{
+private:
+    /**
+     *  The set
+     *  @var std::set
+     */
+    std::set<std::tuple<uint16_t,DNS::Ip,DNS::Processor*>> _processors;
+
+public:
+    void add(DNS::Processor *processor, const DNS::Ip &ip, uint16_t id, uint16_t original) { _processors.emplace(id, ip, processor); }
+    void remove(DNS::Processor *processor, const DNS::Ip &ip, uint16_t id) { _processors.erase(std::make_tuple(id, ip, processor)); }
+    DNS::Processor *find(const DNS::Ip &ip, uint16_t id) const
+    {
+        // look up the first match
+        auto iter = _processors.lower_bound(std::make_tuple(id, ip, nullptr));
+
+        // check if it matches
+        if (iter == _processors.end() || std::get<0>(*iter) != id || std::get<1>(*iter) != ip) return nullptr;
+
+        // found it
+        return std::get<2>(*iter);
+    }
+};
+
+/**
+ *  Run one benchmark and print the results
+ *  @param  name        name of the benchmark
+ *  @param  inflight    number of lookups in flight
+ */
+template <typename TABLE>
+static void run(const char *name, size_t inflight)
+{
+    // the nameservers
+    std::vector<DNS::Ip> nameservers = { DNS::Ip("8.8.8.8"), DNS::Ip("1.1.1.1"), DNS::Ip("2001:4860:4860::8888") };
+
+    // the lookups (we just use fake pointers, the processors are never called)
+    struct Lookup { DNS::Processor *processor; DNS::Ip ip; uint16_t id; };
+    std::vector<Lookup> lookups;
+
+    // random ID's, just like the real queries
+    std::mt19937 generator(inflight);
+
+    // create the lookups
+    for (size_t i = 0; i < inflight; ++i) lookups.push_back(Lookup{ (DNS::Processor *)(0x1000 + i * 64), nameservers[i % nameservers.size()], (uint16_t)generator() });
+
+    // the table to test
+    TABLE table;
+
+    // number of found processors (to avoid that the compiler optimizes things away)
+    size_t found = 0;
+
+    // start time
+    auto start = std::chrono::steady_clock::now();
+
+    // run a number of rounds
+    for (size_t round = 0; round < rounds; ++round)
+    {
+        // all lookups are sent
+        for (const auto &lookup : lookups) table.add(lookup.processor, lookup.ip, lookup.id, lookup.id);
+
+        // all responses come in, and the lookups unsubscribe
+        for (const auto &lookup : lookups)
+        {
+            // dispatch the response
+            if (table.find(lookup.ip, lookup.id) != nullptr) found += 1;
+
+            // unsubscribe
+            table.remove(lookup.processor, lookup.ip, lookup.id);
+        }
+    }
+
+    // elapsed time
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    // report
+    std::cout << std::left << std::setw(10) << name
+              << " inflight: " << std::setw(8) << inflight
+              << " ns/lookup: " << std::setw(10) << elapsed.count() / (rounds * inflight)
+              << " dispatched: " << found << std::endl;
+}
+
+/**
+ *  Main procedure
+ *  @return int
+ */
+int main()
+{
+    // run the tests for different numbers of lookups
+    for (size_t inflight : { 1000, 10000, 32000 })
+    {
+        // compare the two implementations
+        run<Tree>("std::set", inflight);
+        run<DNS::Processors>("flat", inflight);
+    }
+
+    // done
+    return 0;
+}
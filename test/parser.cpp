@@ -0,0 +1,220 @@
+/**
+ *  Parser.cpp
+ *
+ *  Benchmark program that compares parsing a corpus of typical responses
+ *  with libresolv (ns_initparse(), ns_parserr() and ns_name_uncompress())
+ *  versus the native parser that is used by the Message and Record classes
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include <dnscpp.h>
+#include <resolv.h>
+#include "corpus.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+
+/**
+ *  Number of rounds to run per benchmark
+ *  @var size_t
+ */
+static const size_t rounds = 20000;
+
+/**
+ *  Run one benchmark and print the results
+ *  @param  name        name of the benchmark
+ *  @param  callback    function that parses one response, and returns a checksum
+ *  @return double      nanoseconds per response
+ */
+template <typename CALLBACK>
+static double run(const char *name, const CALLBACK &callback)
+{
+    // the responses
+    auto responses = corpus();
+
+    // checksum (to avoid that the compiler optimizes things away)
+    size_t checksum = 0;
+
+    // the fastest run (we do a couple of runs to filter out noise)
+    double result = 0.0;
+
+    // run the benchmark a couple of times
+    for (size_t attempt = 0; attempt < 5; ++attempt)
+    {
+        // start time
+        auto start = std::chrono::steady_clock::now();
+
+        // run a number of rounds
+        for (size_t round = 0; round < rounds; ++round)
+        {
+            // parse all responses
+            for (const auto &response : responses) checksum += callback(response.data(), response.size());
+        }
+
+        // elapsed time
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+        // the time per response
+        double current = elapsed.count() / (rounds * responses.size());
+
+        // remember the fastest run
+        if (attempt == 0 || current < result) result = current;
+    }
+
+    // report
+    std::cout << std::left << std::setw(10) << name << " ns/response: " << std::setw(10) << result << " checksum: " << checksum / rounds / 5 << std::endl;
+
+    // done
+    return result;
+}
+
+/**
+ *  Main procedure
+ *  @return int
+ */
+int main()
+{
+    // decode everything with libresolv (the names of all records, and the names in the record data)
+    double before = run("libresolv", [](const unsigned char *data, size_t size) -> size_t {
+
+        // parse the message
+        ns_msg handle;
+        if (ns_initparse(data, size, &handle) != 0) return 0;
+
+        // the checksum
+        size_t result = 0;
+
+        // visit all records
+        for (auto section : { ns_s_qd, ns_s_an, ns_s_ns, ns_s_ar })
+        {
+            for (int i = 0; i < ns_msg_count(handle, section); ++i)
+            {
+                // parse the record
+                ns_rr record;
+                if (ns_parserr(&handle, section, i, &record) != 0) return 0;
+
+                // the name of the record
+                result += strlen(ns_rr_name(record));
+
+                // names in the record data must be decompressed too (questions do not have data)
+                char name[MAXDNAME];
+                switch (section == ns_s_qd ? 0 : ns_rr_type(record)) {
+                case ns_t_cname:
+                case ns_t_ns:   if (ns_name_uncompress(data, data + size, ns_rr_rdata(record), name, sizeof(name)) >= 0) result += strlen(name); break;
+                case ns_t_mx:   if (ns_name_uncompress(data, data + size, ns_rr_rdata(record) + 2, name, sizeof(name)) >= 0) result += strlen(name); break;
+                case ns_t_soa:  if (ns_name_uncompress(data, data + size, ns_rr_rdata(record), name, sizeof(name)) >= 0) result += strlen(name); break;
+                default:        result += ns_rr_rdlen(record); break;
+                }
+            }
+        }
+
+        // done
+        return result;
+    });
+
+    // decode everything with the native parser
+    double after = run("native", [](const unsigned char *data, size_t size) -> size_t {
+
+        // parse the message
+        DNS::Response response(data, size);
+
+        // the checksum
+        size_t result = 0;
+
+        // visit all records
+        for (auto section : { ns_s_qd, ns_s_an, ns_s_ns, ns_s_ar })
+        {
+            for (size_t i = 0; i < response.records(section); ++i)
+            {
+                // parse the record
+                DNS::Record record(response, section, i);
+
+                // the name of the record
+                result += strlen(record.name());
+
+                // names in the record data must be decompressed too (questions do not have data)
+                switch (section == ns_s_qd ? 0 : record.type()) {
+                case ns_t_cname:    result += strlen(DNS::CNAME(response, record).target()); break;
+                case ns_t_ns:       result += strlen(DNS::NS(response, record).nameserver()); break;
+                case ns_t_mx:       result += strlen(DNS::MX(response, record).hostname()); break;
+                case ns_t_soa:      result += strlen(DNS::SOA(response, record).nameserver()); break;
+                default:            result += record.size(); break;
+                }
+            }
+        }
+
+        // done
+        return result;
+    });
+
+    // report the speedup
+    std::cout << "speedup: " << before / after << std::endl;
+
+    // the typical case: only the type, ttl and data of the records are needed (this is what the library 
+    // itself does when it checks, caches and reports responses), and the names are not decompressed
+    before = run("libresolv", [](const unsigned char *data, size_t size) -> size_t {
+
+        // parse the message
+        ns_msg handle;
+        if (ns_initparse(data, size, &handle) != 0) return 0;
+
+        // the checksum
+        size_t result = 0;
+
+        // visit all records
+        for (auto section : { ns_s_an, ns_s_ns, ns_s_ar })
+        {
+            for (int i = 0; i < ns_msg_count(handle, section); ++i)
+            {
+                // parse the record (this always decompresses the name)
+                ns_rr record;
+                if (ns_parserr(&handle, section, i, &record) != 0) return 0;
+
+                // use the type, ttl and data
+                result += ns_rr_type(record) + ns_rr_ttl(record) + ns_rr_rdlen(record);
+            }
+        }
+
+        // done
+        return result;
+    });
+
+    // the typical case with the native parser
+    after = run("native", [](const unsigned char *data, size_t size) -> size_t {
+
+        // parse the message
+        DNS::Response response(data, size);
+
+        // the checksum
+        size_t result = 0;
+
+        // visit all records
+        for (auto section : { ns_s_an, ns_s_ns, ns_s_ar })
+        {
+            for (size_t i = 0; i < response.records(section); ++i)
+            {
+                // parse the record (the name is not decompressed until it is used)
+                DNS::Record record(response, section, i);
+
+                // use the type, ttl and data
+                result += record.type() + record.ttl() + record.size();
+            }
+        }
+
+        // done
+        return result;
+    });
+
+    // report the speedup
+    std::cout << "speedup: " << before / after << std::endl;
+
+    // done
+    return 0;
+}
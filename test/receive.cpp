@@ -0,0 +1,188 @@
+/**
+ *  Receive.cpp
+ *
+ *  Benchmark program that compares the number of system calls that are
+ *  needed to receive a burst of responses: one recvfrom() call per datagram
+ *  (the old approach) versus batched recvmmsg() calls (the current approach)
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include <dnscpp.h>
+#include <dnscpp/datagrams.h>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <unistd.h>
+
+/**
+ *  Number of datagrams in each burst, and the total number of datagrams
+ *  @var size_t
+ */
+static const size_t burst = 64;
+static const size_t total = 200000;
+
+/**
+ *  Helper function to create a non-blocking UDP socket bound to the loopback address
+ *  @param  address     the address that is filled with the bound address
+ *  @return int
+ */
+static int create(struct sockaddr_in &address)
+{
+    // create the socket
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    // make sure a full burst fits in the receive buffer
+    int size = 4 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    // bind to a random port on the loopback address
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(fd, (struct sockaddr *)&address, sizeof(address));
+
+    // find out the port that was assigned
+    socklen_t length = sizeof(address);
+    getsockname(fd, (struct sockaddr *)&address, &length);
+
+    // done
+    return fd;
+}
+
+/**
+ *  Send a burst of fake responses
+ *  @param  fd          sending socket
+ *  @param  address     target address
+ */
+static void send(int fd, const struct sockaddr_in &address)
+{
+    // a response-like payload
+    unsigned char payload[120] = { 0x12, 0x34, 0x81, 0x80 };
+
+    // send the burst
+    for (size_t i = 0; i < burst; ++i) sendto(fd, payload, sizeof(payload), 0, (const struct sockaddr *)&address, sizeof(address));
+}
+
+/**
+ *  Run one benchmark and print the results
+ *  @param  name        name of the benchmark
+ *  @param  drain       function that drains the socket, and returns the number of syscalls and datagrams
+ */
+template <typename CALLABLE>
+static void run(const char *name, const CALLABLE &drain)
+{
+    // create the sockets
+    struct sockaddr_in address, unused;
+    int receiver = create(address), sender = create(unused);
+
+    // counters
+    size_t syscalls = 0, datagrams = 0;
+
+    // start time
+    auto start = std::chrono::steady_clock::now();
+
+    // send and receive bursts
+    while (datagrams < total)
+    {
+        // send the datagrams
+        send(sender, address);
+
+        // and receive them all
+        size_t received = 0;
+        while (received < burst) received += drain(receiver, syscalls);
+
+        // update counter
+        datagrams += received;
+    }
+
+    // elapsed time
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    // report
+    std::cout << std::left << std::setw(20) << name
+              << " syscalls/response: " << std::setw(10) << (double)syscalls / datagrams
+              << " ns/response: " << elapsed.count() / datagrams << std::endl;
+
+    // close the sockets
+    close(receiver); close(sender);
+}
+
+/**
+ *  Main procedure
+ *  @return int
+ */
+int main()
+{
+    // the old approach: one recvfrom() per datagram until EAGAIN
+    run("recvfrom", [](int fd, size_t &syscalls) -> size_t {
+
+        // result variable
+        size_t result = 0;
+
+        // buffer to receive the datagram in
+        std::vector<unsigned char> buffer;
+
+        // read until depleted
+        while (true)
+        {
+            // allocate a buffer, just like the old Udp::notify() did
+            buffer.resize(DNS::EDNSPacketSize);
+
+            // structure for the source address
+            struct sockaddr_in6 from; socklen_t fromlen = sizeof(from);
+
+            // receive the message
+            auto bytes = recvfrom(fd, buffer.data(), buffer.size(), MSG_DONTWAIT, (struct sockaddr *)&from, &fromlen);
+            syscalls += 1;
+
+            // if there were no bytes, leap out
+            if (bytes <= 0) return result;
+
+            // the response was moved into the response list
+            std::vector<unsigned char>().swap(buffer);
+            result += 1;
+        }
+    });
+
+    // the new approach, with different batch sizes
+    for (size_t slots : { 1, 8, 16, 64 })
+    {
+        // the slots
+        DNS::Datagrams datagrams(slots);
+
+        // name of the test
+        std::string name = "recvmmsg (" + std::to_string(slots) + ")";
+
+        // run the test
+        run(name.data(), [&datagrams](int fd, size_t &syscalls) -> size_t {
+
+            // result variable
+            size_t result = 0;
+
+            // read until depleted
+            while (true)
+            {
+                // receive multiple datagrams
+                auto count = datagrams.receive(fd);
+                syscalls += 1;
+
+                // if there were no messages, leap out
+                if (count <= 0) return result;
+
+                // update result
+                result += count;
+
+                // if not all slots were filled, the socket has been drained
+                if (count < (int)datagrams.capacity()) return result;
+            }
+        });
+    }
+
+    // done
+    return 0;
+}
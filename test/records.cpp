@@ -0,0 +1,177 @@
+/**
+ *  Records.cpp
+ *
+ *  Benchmark program that compares the cost of accessing all records in a
+ *  large response: via ns_parserr() (which walks the message from the start
+ *  for every record) versus the Record class (which uses the index that is
+ *  stored in the message)
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include <dnscpp.h>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+
+/**
+ *  Number of rounds to run per benchmark
+ *  @var size_t
+ */
+static const size_t rounds = 1000;
+
+/**
+ *  Helper function to construct a response with a number of TXT records in the answer section
+ *  @param  count       number of records
+ *  @return std::vector
+ */
+static std::vector<unsigned char> construct(size_t count)
+{
+    // the header: id, flags (response, recursion desired and available), one question and the answers
+    std::vector<unsigned char> result = { 0x12, 0x34, 0x81, 0x80, 0x00, 0x01, (unsigned char)(count >> 8), (unsigned char)count, 0x00, 0x00, 0x00, 0x00 };
+
+    // the question: example.com TXT IN
+    result.insert(result.end(), { 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0, 0, 16, 0, 1 });
+
+    // add the records
+    for (size_t i = 0; i < count; ++i)
+    {
+        // the text in the record
+        std::string text = "record number " + std::to_string(i);
+
+        // name (pointer to the question), type, class, ttl and rdlength
+        result.insert(result.end(), { 0xc0, 0x0c, 0, 16, 0, 1, 0, 0, 0x0e, 0x10, 0, (unsigned char)(text.size() + 1) });
+
+        // the rdata
+        result.push_back(text.size());
+        result.insert(result.end(), text.begin(), text.end());
+    }
+
+    // done
+    return result;
+}
+
+/**
+ *  Run one benchmark and print the results
+ *  @param  name        name of the benchmark
+ *  @param  count       number of records in the response
+ *  @param  callback    function that accesses all records, and returns the number of bytes found
+ */
+template <typename CALLBACK>
+static void run(const char *name, size_t count, const CALLBACK &callback)
+{
+    // construct the response
+    auto buffer = construct(count);
+
+    // number of bytes found (to avoid that the compiler optimizes things away)
+    size_t found = 0;
+
+    // start time
+    auto start = std::chrono::steady_clock::now();
+
+    // run a number of rounds (every round uses a new message, so that the index is built every time)
+    for (size_t round = 0; round < rounds; ++round) found += callback(DNS::Response(buffer.data(), buffer.size()));
+
+    // elapsed time
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    // report
+    std::cout << std::left << std::setw(10) << name
+              << " records: " << std::setw(6) << count
+              << " ns/response: " << std::setw(12) << elapsed.count() / rounds
+              << " bytes: " << found / rounds << std::endl;
+}
+
+/**
+ *  Main procedure
+ *  @return int
+ */
+int main()
+{
+    // run the tests for different response sizes
+    for (size_t count : { 10, 100, 250, 1000 })
+    {
+        // the old approach: parse every record with ns_parserr() (this is only fast when records are visited in order)
+        run("parserr", count, [](const DNS::Response &response) -> size_t {
+
+            // copy of the handle
+            ns_msg handle = *response.handle();
+
+            // result
+            size_t result = 0;
+
+            // visit all answers
+            for (size_t i = 0; i < response.answers(); ++i)
+            {
+                // parse the record
+                ns_rr record;
+                if (ns_parserr(&handle, ns_s_an, i, &record) == 0) result += ns_rr_rdlen(record);
+            }
+
+            // done
+            return result;
+        });
+
+        // the same, but in reverse order, so that ns_parserr() has to start at the beginning of the section for every record
+        run("parserr<", count, [](const DNS::Response &response) -> size_t {
+
+            // copy of the handle
+            ns_msg handle = *response.handle();
+
+            // result
+            size_t result = 0;
+
+            // visit all answers
+            for (size_t i = response.answers(); i > 0; --i)
+            {
+                // parse the record
+                ns_rr record;
+                if (ns_parserr(&handle, ns_s_an, i - 1, &record) == 0) result += ns_rr_rdlen(record);
+            }
+
+            // done
+            return result;
+        });
+
+        // the record class (which uses the index of the message)
+        run("record", count, [](const DNS::Response &response) -> size_t {
+
+            // result
+            size_t result = 0;
+
+            // visit all answers
+            for (size_t i = 0; i < response.answers(); ++i) result += DNS::Record(response, ns_s_an, i).size();
+
+            // done
+            return result;
+        });
+
+        // the same, in reverse order
+        run("record<", count, [](const DNS::Response &response) -> size_t {
+
+            // result
+            size_t result = 0;
+
+            // visit all answers
+            for (size_t i = response.answers(); i > 0; --i) result += DNS::Record(response, ns_s_an, i - 1).size();
+
+            // done
+            return result;
+        });
+
+        // counting the records of a certain type
+        run("count", count, [](const DNS::Response &response) -> size_t {
+
+            // count the txt records (the result is not a number of bytes, but that does not matter here)
+            return response.records(ns_s_an, ns_t_txt) + response.rcode();
+        });
+    }
+
+    // done
+    return 0;
+}
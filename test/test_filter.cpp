@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <dnscpp/socketfilter.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <string.h>
+#include <vector>
+
+using namespace DNS;
+
+// helper to open a udp socket on a random loopback port
+static int loopback(int family, sockaddr_storage &address)
+{
+    int fd = socket(family, SOCK_DGRAM, 0);
+    if (fd < 0) return -1;
+    memset(&address, 0, sizeof(address));
+    socklen_t size = family == AF_INET ? sizeof(sockaddr_in) : sizeof(sockaddr_in6);
+    address.ss_family = family;
+    if (family == AF_INET) ((sockaddr_in *)&address)->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    else ((sockaddr_in6 *)&address)->sin6_addr = in6addr_loopback;
+    if (bind(fd, (sockaddr *)&address, size) != 0 || getsockname(fd, (sockaddr *)&address, &size) != 0) { close(fd); return -1; }
+    return fd;
+}
+
+// the port of an address
+static uint16_t port(const sockaddr_storage &address)
+{
+    return ntohs(address.ss_family == AF_INET ? ((const sockaddr_in *)&address)->sin_port : ((const sockaddr_in6 *)&address)->sin6_port);
+}
+
+// send junk and a single valid response to a filtered socket, only the response may arrive
+static void run(int family)
+{
+    sockaddr_storage receiver, server, other;
+    int fd = loopback(family, receiver), from = loopback(family, server), wrong = loopback(family, other);
+    if (fd < 0 || from < 0 || wrong < 0) GTEST_SKIP() << "no loopback for this address family";
+    socklen_t size = family == AF_INET ? sizeof(sockaddr_in) : sizeof(sockaddr_in6);
+
+    // the "nameserver" is the socket from which we accept responses
+    ASSERT_TRUE(SocketFilter::attach(fd, port(server)));
+
+    // a response header (id 0x1234, QR set), a query header (QR not set), and a truncated header
+    unsigned char response[] = { 0x12, 0x34, 0x81, 0x80, 0, 1, 0, 0, 0, 0, 0, 0 };
+    unsigned char query[] = { 0x56, 0x78, 0x01, 0x00, 0, 1, 0, 0, 0, 0, 0, 0 };
+    unsigned char tiny[] = { 0x9a, 0xbc, 0x81, 0x80, 0 };
+
+    // send the junk first, then the real response
+    sendto(from, query, sizeof(query), 0, (sockaddr *)&receiver, size);
+    sendto(from, tiny, sizeof(tiny), 0, (sockaddr *)&receiver, size);
+    sendto(wrong, response, sizeof(response), 0, (sockaddr *)&receiver, size);
+    sendto(from, response, sizeof(response), 0, (sockaddr *)&receiver, size);
+
+    // read everything that reached user space
+    std::vector<std::vector<unsigned char>> received;
+    unsigned char buffer[512];
+    ssize_t bytes;
+    while ((bytes = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT)) >= 0) received.emplace_back(buffer, buffer + bytes);
+
+    // only the real response got through
+    ASSERT_EQ(received.size(), 1u);
+    EXPECT_EQ(received[0], std::vector<unsigned char>(response, response + sizeof(response)));
+
+    // without the filter, everything arrives
+    ASSERT_TRUE(SocketFilter::detach(fd));
+    sendto(from, query, sizeof(query), 0, (sockaddr *)&receiver, size);
+    sendto(wrong, response, sizeof(response), 0, (sockaddr *)&receiver, size);
+    size_t count = 0;
+    while (recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) >= 0) count += 1;
+    EXPECT_EQ(count, 2u);
+
+    close(fd); close(from); close(wrong);
+}
+
+// junk from ipv4 peers is dropped by the kernel
+TEST(SocketFilter, DropsJunkV4)
+{
+    run(AF_INET);
+}
+
+// junk from ipv6 peers is dropped by the kernel
+TEST(SocketFilter, DropsJunkV6)
+{
+    run(AF_INET6);
+}
@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+#include <dnscpp.h>
+#include <resolv.h>
+#include <string.h>
+#include "corpus.h"
+
+using namespace DNS;
+
+// compare a record parsed by libresolv with the same record parsed by the native parser
+static void compare(const std::vector<unsigned char> &data, const ns_rr &expected, const Response &response, ns_sect section, int index)
+{
+    Record record(response, section, index);
+    EXPECT_STREQ(record.name(), ns_rr_name(expected));
+    EXPECT_EQ(record.type(), ns_rr_type(expected));
+    EXPECT_EQ(record.dnsclass(), ns_rr_class(expected));
+    if (section == ns_s_qd) return;
+    EXPECT_EQ(record.ttl(), ns_rr_ttl(expected));
+    EXPECT_EQ(record.size(), ns_rr_rdlen(expected));
+    EXPECT_EQ(record.data() - response.data(), ns_rr_rdata(expected) - data.data());
+
+    // names in the record data are decompressed the same way
+    char name[MAXDNAME];
+    switch (record.type()) {
+    case ns_t_cname:
+        ASSERT_GE(ns_name_uncompress(data.data(), data.data() + data.size(), ns_rr_rdata(expected), name, sizeof(name)), 0);
+        EXPECT_STREQ(CNAME(response, record).target(), name);
+        break;
+    case ns_t_ns:
+        ASSERT_GE(ns_name_uncompress(data.data(), data.data() + data.size(), ns_rr_rdata(expected), name, sizeof(name)), 0);
+        EXPECT_STREQ(NS(response, record).nameserver(), name);
+        break;
+    case ns_t_mx:
+        ASSERT_GE(ns_name_uncompress(data.data(), data.data() + data.size(), ns_rr_rdata(expected) + 2, name, sizeof(name)), 0);
+        EXPECT_STREQ(MX(response, record).hostname(), name);
+        break;
+    }
+}
+
+// the native parser gives the same results as libresolv for all records in the corpus
+TEST(Parser, SameAsLibresolv)
+{
+    for (const auto &data : corpus())
+    {
+        ns_msg handle;
+        ASSERT_EQ(ns_initparse(data.data(), data.size(), &handle), 0);
+        Response response(data.data(), data.size());
+
+        EXPECT_EQ(response.id(), ns_msg_id(handle));
+        EXPECT_EQ(response.size(), (size_t)ns_msg_size(handle));
+        EXPECT_EQ(response.rcode(), ns_msg_getflag(handle, ns_f_rcode));
+        EXPECT_EQ(response.truncated(), (bool)ns_msg_getflag(handle, ns_f_tc));
+
+        for (auto section : { ns_s_qd, ns_s_an, ns_s_ns, ns_s_ar })
+        {
+            ASSERT_EQ(response.records(section), ns_msg_count(handle, section));
+            for (int i = 0; i < ns_msg_count(handle, section); ++i)
+            {
+                ns_rr expected;
+                ASSERT_EQ(ns_parserr(&handle, section, i, &expected), 0);
+                compare(data, expected, response, section, i);
+            }
+        }
+    }
+}
+
+// the handle that the native parser fills in can still be used by libresolv itself
+TEST(Parser, HandleUsableByLibresolv)
+{
+    for (const auto &data : corpus())
+    {
+        ns_msg handle;
+        ASSERT_EQ(ns_initparse(data.data(), data.size(), &handle), 0);
+        Response response(data.data(), data.size());
+
+        for (auto section : { ns_s_an, ns_s_ns, ns_s_ar, ns_s_qd })
+        {
+            for (int i = ns_msg_count(handle, section) - 1; i >= 0; --i)
+            {
+                ns_rr expected, record;
+                ASSERT_EQ(ns_parserr(&handle, section, i, &expected), 0);
+                ASSERT_EQ(ns_parserr((ns_msg *)response.handle(), section, i, &record), 0);
+                EXPECT_STREQ(ns_rr_name(record), ns_rr_name(expected));
+                EXPECT_EQ(ns_rr_type(record), ns_rr_type(expected));
+                EXPECT_EQ(ns_rr_rdlen(record), ns_rr_rdlen(expected));
+                EXPECT_EQ(ns_rr_rdata(record) - response.data(), ns_rr_rdata(expected) - data.data());
+            }
+        }
+    }
+}
+
+// build a message with one answer, the owner name of the answer is added by the callback
+template <typename CALLBACK>
+static std::vector<unsigned char> answer(const CALLBACK &owner)
+{
+    Builder builder(ns_r_noerror, 1, 0, 0);
+    builder.question("www.example.com", ns_t_a);
+    owner(builder);
+    builder.fields(ns_t_a, 4);
+    builder.raw({ 127, 0, 0, 1 });
+    return builder.data();
+}
+
+// check that a message can be parsed, but that its answer is rejected (by libresolv too)
+static void rejected(const std::vector<unsigned char> &data)
+{
+    ns_msg handle; ns_rr expected;
+    ASSERT_EQ(ns_initparse(data.data(), data.size(), &handle), 0);
+    EXPECT_NE(ns_parserr(&handle, ns_s_an, 0, &expected), 0);
+
+    Response response(data.data(), data.size());
+    ASSERT_EQ(response.answers(), 1);
+    Record record;
+    EXPECT_FALSE(record.parse(response, ns_s_an, 0));
+    EXPECT_THROW(Record(response, ns_s_an, 0), std::runtime_error);
+
+    // the question is still fine
+    EXPECT_STREQ(Record(response, ns_s_qd, 0).name(), "www.example.com");
+}
+
+// a name that points to itself
+TEST(Parser, PointerLoop)
+{
+    rejected(answer([](Builder &builder) { builder.name("", builder.data().size()); }));
+}
+
+// two names that point to each other (the second one is in the record data)
+TEST(Parser, PointerCycle)
+{
+    Builder builder(ns_r_noerror, 1, 0, 0);
+    builder.question("www.example.com", ns_t_cname);
+    size_t owner = builder.name("", builder.data().size() + 2 + NS_RRFIXEDSZ);
+    builder.fields(ns_t_cname, 6);
+    builder.raw({ 3, 'w', 'w', 'w', 0xc0, (unsigned char)owner });
+    rejected(builder.data());
+}
+
+// a pointer beyond the end of the message
+TEST(Parser, PointerOutOfBounds)
+{
+    rejected(answer([](Builder &builder) { builder.name("", 0x3fff); }));
+}
+
+// a name of more than 255 bytes
+TEST(Parser, NameTooLong)
+{
+    std::string label(63, 'a');
+    rejected(answer([&label](Builder &builder) { builder.name(label + "." + label + "." + label + "." + label + "." + label); }));
+}
+
+// a name of exactly 255 bytes is fine
+TEST(Parser, NameLongest)
+{
+    std::string label(63, 'a');
+    std::string name = label + "." + label + "." + label + "." + std::string(61, 'b');
+    auto data = answer([&name](Builder &builder) { builder.name(name); });
+    Response response(data.data(), data.size());
+    EXPECT_EQ(Record(response, ns_s_an, 0).name(), name);
+}
+
+// messages that end in the middle of a record are rejected as a whole
+TEST(Parser, TruncatedRecords)
+{
+    auto data = answer([](Builder &builder) { builder.name("", 12); });
+    for (size_t size = 0; size < data.size(); ++size)
+    {
+        ns_msg handle;
+        EXPECT_NE(ns_initparse(data.data(), size, &handle), 0) << "size " << size;
+        EXPECT_THROW(Response(data.data(), size), std::runtime_error) << "size " << size;
+        Response response;
+        EXPECT_FALSE(response.parse(data.data(), size)) << "size " << size;
+        EXPECT_EQ(response.answers(), 0);
+    }
+
+    // the full message is fine
+    Response response(data.data(), data.size());
+    EXPECT_STREQ(Record(response, ns_s_an, 0).name(), "www.example.com");
+}
@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+#include <dnscpp/processors.h>
+#include <set>
+
+using namespace DNS;
+
+// fake processor pointers (the table never calls them)
+static Processor *fake(size_t i) { return (Processor *)(0x1000 + i * 64); }
+
+// pop all processors, and check that every processor is returned exactly once
+static std::multiset<Processor *> drain(Processors &table)
+{
+    std::multiset<Processor *> result;
+    while (auto *processor = table.pop()) result.insert(processor);
+    return result;
+}
+
+// the entries are found by ip and id, and the original id is returned too
+TEST(Processors, Find)
+{
+    Processors table;
+    Ip ip1("127.0.0.1"), ip2("::1");
+    table.add(fake(1), ip1, 100, 1);
+    table.add(fake(2), ip2, 100, 2);
+
+    uint16_t original = 0;
+    EXPECT_EQ(table.find(ip1, 100, original), fake(1));
+    EXPECT_EQ(original, 1);
+    EXPECT_EQ(table.find(ip2, 100, original), fake(2));
+    EXPECT_EQ(original, 2);
+    EXPECT_EQ(table.find(ip1, 101), nullptr);
+
+    EXPECT_TRUE(table.remove(fake(1), ip1, 100));
+    EXPECT_FALSE(table.remove(fake(1), ip1, 100));
+    EXPECT_EQ(table.find(ip1, 100), nullptr);
+    EXPECT_EQ(table.size(), 1);
+}
+
+// popping empties the table, every processor is returned once
+TEST(Processors, Pop)
+{
+    Processors table;
+    Ip ip("127.0.0.1");
+    std::multiset<Processor *> expected;
+
+    // ids close to each other, so that there are long chains (also around the end of the table)
+    for (size_t i = 0; i < 1000; ++i) { table.add(fake(i), ip, uint16_t(65000 + i * 7), 0); expected.insert(fake(i)); }
+
+    EXPECT_EQ(drain(table), expected);
+    EXPECT_TRUE(table.empty());
+    EXPECT_EQ(table.pop(), nullptr);
+}
+
+// entries that are added or removed while the table is emptied are handled too
+TEST(Processors, PopWhileChanging)
+{
+    Processors table;
+    Ip ip("127.0.0.1");
+    for (size_t i = 0; i < 100; ++i) table.add(fake(i), ip, uint16_t(i * 13), 0);
+
+    // pop a couple, then add new ones (these may end up in slots that were already visited) and remove some others
+    std::multiset<Processor *> result;
+    for (size_t i = 0; i < 50; ++i) result.insert(table.pop());
+    for (size_t i = 100; i < 120; ++i) table.add(fake(i), ip, uint16_t(i * 13), 0);
+    for (size_t i = 0; i < 100; ++i) if (i % 10 == 0 && table.remove(fake(i), ip, uint16_t(i * 13))) result.insert(fake(i));
+
+    // the rest is returned by pop()
+    for (auto *processor : drain(table)) result.insert(processor);
+
+    // every processor was returned exactly once
+    std::multiset<Processor *> expected;
+    for (size_t i = 0; i < 120; ++i) expected.insert(fake(i));
+    EXPECT_EQ(result, expected);
+    EXPECT_TRUE(table.empty());
+}
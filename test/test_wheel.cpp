@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include <dnscpp/wheel.h>
+#include <vector>
+
+using namespace DNS;
+
+// entry that remembers a number, so that we can check the order
+struct Item : public Wheel::Entry
+{
+    int value;
+    Item(int value) : value(value) {}
+};
+
+// pop all expired entries
+static std::vector<int> expired(Wheel &wheel)
+{
+    std::vector<int> result;
+    while (auto *entry = wheel.pop()) result.push_back(static_cast<Item *>(entry)->value);
+    return result;
+}
+
+// an empty wheel has nothing to do
+TEST(Wheel, Empty)
+{
+    Wheel wheel(100.0);
+    EXPECT_TRUE(wheel.empty());
+    EXPECT_LT(wheel.next(), 0.0);
+    EXPECT_EQ(wheel.pop(), nullptr);
+    EXPECT_EQ(wheel.any(), nullptr);
+}
+
+// entries expire at (and not before) their time
+TEST(Wheel, Insert)
+{
+    Wheel wheel(100.0);
+    Item a(1), b(2);
+    wheel.insert(&a, 100.010);
+    wheel.insert(&b, 100.020);
+    EXPECT_FALSE(wheel.empty());
+
+    wheel.advance(100.009);
+    EXPECT_TRUE(expired(wheel).empty());
+
+    wheel.advance(100.010);
+    EXPECT_EQ(expired(wheel), std::vector<int>({ 1 }));
+
+    wheel.advance(100.050);
+    EXPECT_EQ(expired(wheel), std::vector<int>({ 2 }));
+    EXPECT_TRUE(wheel.empty());
+}
+
+// entries in the past are expired right away
+TEST(Wheel, Past)
+{
+    Wheel wheel(100.0);
+    Item a(1);
+    wheel.insert(&a, 99.0);
+    EXPECT_DOUBLE_EQ(wheel.next(), 100.0);
+    EXPECT_EQ(expired(wheel), std::vector<int>({ 1 }));
+}
+
+// removed and moved entries do not expire at their old time
+TEST(Wheel, Cancel)
+{
+    Wheel wheel(100.0);
+    Item a(1), b(2), c(3);
+    wheel.insert(&a, 100.010);
+    wheel.insert(&b, 100.010);
+    wheel.insert(&c, 100.010);
+
+    // remove one entry, and move an other one to later
+    b.unlink();
+    wheel.insert(&c, 105.0);
+    EXPECT_EQ(b.list(), nullptr);
+
+    wheel.advance(100.100);
+    EXPECT_EQ(expired(wheel), std::vector<int>({ 1 }));
+
+    // the entry that was removed from the wheel is gone, after removing the last one the wheel is empty
+    c.unlink();
+    EXPECT_TRUE(wheel.empty());
+}
+
+// entries on the higher levels cascade down and expire at the right tick
+TEST(Wheel, Cascade)
+{
+    Wheel wheel(100.0);
+
+    // level 0 (ms), level 1 (seconds), level 2 (minutes), level 3 (hours), and beyond the range of the wheel
+    double times[] = { 0.005, 1.5, 100.0, 3600.0, 100000.0 };
+    Item items[] = { {0}, {1}, {2}, {3}, {4} };
+    for (size_t i = 0; i < 5; ++i) wheel.insert(&items[i], 100.0 + times[i]);
+
+    // advance in small and big steps, every entry should expire in the step that contains its time
+    for (size_t i = 0; i < 5; ++i)
+    {
+        // just before the time nothing expires
+        wheel.advance(100.0 + times[i] - 0.001);
+        EXPECT_TRUE(expired(wheel).empty()) << "entry " << i << " expired too early";
+
+        // at the time the entry expires
+        wheel.advance(100.0 + times[i]);
+        EXPECT_EQ(expired(wheel), std::vector<int>({ int(i) }));
+    }
+    EXPECT_TRUE(wheel.empty());
+}
+
+// the next time is a lower bound for the first entry, and exact on the lowest level
+TEST(Wheel, Next)
+{
+    Wheel wheel(100.0);
+    Item a(1), b(2);
+
+    wheel.insert(&a, 130.0);
+    double next = wheel.next();
+    EXPECT_GT(next, 100.0);
+    EXPECT_LE(next, 130.0);
+
+    // an earlier entry becomes the next one
+    wheel.insert(&b, 100.025);
+    EXPECT_DOUBLE_EQ(wheel.next(), 100.025);
+
+    // after it expired, the wheel points to the later entry again
+    wheel.advance(100.025);
+    EXPECT_DOUBLE_EQ(wheel.next(), 100.025);
+    EXPECT_EQ(expired(wheel), std::vector<int>({ 2 }));
+    EXPECT_GT(wheel.next(), 100.025);
+    EXPECT_LE(wheel.next(), 130.0);
+
+    // advancing to the lower bound never expires the entry too early
+    while (wheel.next() < 130.0 && wheel.next() >= 0.0) { wheel.advance(wheel.next()); EXPECT_TRUE(expired(wheel).empty()); }
+    wheel.advance(130.0);
+    EXPECT_EQ(expired(wheel), std::vector<int>({ 1 }));
+}